@@ -1,36 +1,101 @@
 #include "channel.h"
 #include "internal_msgsend.h"
 #include "qnxcomm_internal.h"
+#include "msgsend_pool.h"
+#include "submit_ring.h"
 
 #include <linux/slab.h>
 
 
-static 
-atomic_t gbl_next_channel_id = ATOMIC_INIT(0);   
-
-
-static
-int get_new_channel_id(void)
-{
-   return atomic_inc_return(&gbl_next_channel_id);
-}
-
-
-int qnx_channel_init(struct qnx_channel* chnl)
+int qnx_channel_init(struct qnx_channel* chnl, unsigned int flags, pid_t pid)
 {
+   chnl->noreply_pool = 0;
+   
+   if (flags & QNX_CHF_NOREPLY_POOL)
+   {
+      chnl->noreply_pool = (struct qnx_msgsend_pool*)kmalloc(sizeof(struct qnx_msgsend_pool), GFP_USER);
+      if (unlikely(!chnl->noreply_pool))
+         return -ENOMEM;
+         
+      if (unlikely(qnx_msgsend_pool_init(chnl->noreply_pool, qnx_max_noreply_msg_num, qnx_max_noreply_msg_size)))
+      {
+         kfree(chnl->noreply_pool);
+         return -ENOMEM;
+      }
+   }
+   
    kref_init(&chnl->refcnt);
-   chnl->chid = get_new_channel_id();   
+   chnl->chid = 0;
+   chnl->pid = pid;
+   chnl->flags = flags;
 
-   INIT_LIST_HEAD(&chnl->waiting);
+   init_llist_head(&chnl->incoming);
+   qnx_msg_queue_init(&chnl->waiting);
+   qnx_msg_queue_init(&chnl->pulse_queue);
+   chnl->next_seq = 0;
    atomic_set(&chnl->num_waiting, 0);
    
    init_waitqueue_head(&chnl->waiting_queue);
+   qnx_idle_receivers_init(&chnl->receivers, flags);
+   qnx_idle_receivers_init(&chnl->pulse_receivers, flags);
    
    spin_lock_init(&chnl->waiting_lock);
    
-   chnl->num_waiting_noreply = 0;
+   atomic_set(&chnl->num_waiting_noreply, 0);
+   
+   INIT_LIST_HEAD(&chnl->rings);
+   
+   qnx_pulse_pool_init(&chnl->pulses);
+   
+   init_waitqueue_head(&chnl->space_queue);
+   INIT_LIST_HEAD(&chnl->noreply_notify);
+   
+   chnl->destroyed = 0;
+   
+   return 0;
+}
+
+
+static inline
+int noreply_low_watermark(void)
+{
+   return qnx_noreply_low_watermark ? qnx_noreply_low_watermark : qnx_max_noreply_msg_num / 2;
+}
+
+
+static
+void qnx_noreply_notify_fire(struct qnx_noreply_notify* notify)
+{
+   if (qnx_channel_add_new_message(notify->chnl, notify->pulse))
+      qnx_internal_msgsend_free(notify->pulse);
+   
+   qnx_channel_release(notify->chnl);
+   kfree(notify);
+}
+
+
+static
+void qnx_noreply_notify_free(struct qnx_noreply_notify* notify)
+{
+   qnx_internal_msgsend_free(notify->pulse);
+   
+   qnx_channel_release(notify->chnl);
+   kfree(notify);
+}
+
+
+/// the last reference may vfree the ring, so this must not be called with a spinlock held
+static
+void release_rings(struct list_head* rings)
+{
+   struct qnx_submit_ring* ring;
+   struct qnx_submit_ring* next;
    
-   return chnl->chid;
+   list_for_each_entry_safe(ring, next, rings, chnl_hook)
+   {
+      list_del_init(&ring->chnl_hook);
+      qnx_submit_ring_release(ring);
+   }
 }
 
 
@@ -41,21 +106,42 @@ void qnx_channel_free(struct kref* refcount)
    
    struct list_head* iter;
    struct list_head* next;
+   
+   LIST_HEAD(waiting);
+   LIST_HEAD(rings);
 
    printk("qnx_channel_free called\n");
 
    spin_lock(&chnl->waiting_lock);
    
-   list_for_each_safe(iter, next, &chnl->waiting)
+   qnx_channel_take_incoming(chnl);
+   qnx_msg_queue_splice(&chnl->waiting, &waiting);
+   qnx_msg_queue_splice(&chnl->pulse_queue, &waiting);
+   
+   list_for_each_safe(iter, next, &waiting)
    {      
       pr_debug("Removing pending entry\n");
-      qnx_internal_msgsend_cleanup_and_free(list_entry(iter, struct qnx_internal_msgsend, hook));
       list_del(iter);      
+      qnx_internal_msgsend_cleanup_and_free(list_entry(iter, struct qnx_internal_msgsend, hook));
    }
    
+   list_splice_init(&chnl->rings, &rings);
+   
    spin_unlock(&chnl->waiting_lock);   
 
-   kfree(chnl);
+   // senders still hold their own reference
+   release_rings(&rings);
+
+   // all noreply messages and pulses were given back above
+   if (chnl->noreply_pool)
+   {
+      qnx_msgsend_pool_destroy(chnl->noreply_pool);
+      kfree(chnl->noreply_pool);
+   }
+   
+   qnx_pulse_pool_destroy(&chnl->pulses);
+   
+   kfree_rcu(chnl, rcu);
 }
 
 
@@ -65,34 +151,462 @@ void qnx_channel_release(struct qnx_channel* chnl)
 }
 
 
-int qnx_channel_add_new_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data)
+void qnx_channel_destroy(struct qnx_channel* chnl, struct list_head* queued)
+{
+   struct qnx_internal_msgsend* data;
+   struct qnx_noreply_notify* notify;
+   struct qnx_noreply_notify* next;
+   
+   LIST_HEAD(notifications);
+   LIST_HEAD(waiting);
+   LIST_HEAD(rings);
+   
+   spin_lock(&chnl->waiting_lock);
+   
+   chnl->destroyed = 1;
+   
+   // pairs with the barrier in push_incoming, a sender either sees the flag or 
+   // its messages are taken below
+   smp_mb();
+   
+   list_splice_init(&chnl->noreply_notify, &notifications);
+   
+   // connections may keep the channel alive, but nobody consumes the rings anymore
+   list_splice_init(&chnl->rings, &rings);
+   
+   // blocked senders must not wait for the last connection to go away
+   qnx_channel_take_incoming(chnl);
+   qnx_msg_queue_splice(&chnl->waiting, &waiting);
+   qnx_msg_queue_splice(&chnl->pulse_queue, &waiting);
+   
+   // the caller finishes them, so cancelling senders must wait for that
+   list_for_each_entry(data, &waiting, hook)
+      data->state = QNX_STATE_RECEIVING;
+   
+   list_splice_tail(&waiting, queued);
+   atomic_set(&chnl->num_waiting, 0);
+   atomic_set(&chnl->num_waiting_noreply, 0);
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   release_rings(&rings);
+   
+   // blocked noreply senders see the channel is gone
+   wake_up_interruptible(&chnl->space_queue);
+   
+   list_for_each_entry_safe(notify, next, &notifications, hook)
+      qnx_noreply_notify_free(notify);
+}
+
+
+static inline
+int is_noreply(const struct qnx_internal_msgsend* data)
+{
+   return data->rcvid != 0 && data->task == 0;
+}
+
+
+/// takes a noreply slot without holding the lock, returns 0 if the limit is reached
+static inline
+int reserve_noreply(struct qnx_channel* chnl)
+{
+   int num = atomic_read(&chnl->num_waiting_noreply);
+   int old;
+   
+   for(;;)
+   {
+      if (unlikely(num >= (int)qnx_max_noreply_msg_num))
+         return 0;
+         
+      old = atomic_cmpxchg(&chnl->num_waiting_noreply, num, num + 1);
+      if (likely(old == num))
+         return 1;
+         
+      num = old;
+   }
+}
+
+
+/// waiting_lock must be held, pulses have a queue of their own
+static inline
+void enqueue(struct qnx_channel* chnl, struct qnx_internal_msgsend* data)
+{
+   data->seq = chnl->next_seq++;
+   qnx_msg_queue_add(data->rcvid == 0 ? &chnl->pulse_queue : &chnl->waiting, data);
+}
+
+
+void qnx_channel_take_incoming(struct qnx_channel* chnl)
+{
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+   struct llist_node* first;
+   
+   if (likely(llist_empty(&chnl->incoming)))
+      return;
+      
+   // newest first, so reverse to keep the order of the senders
+   first = llist_reverse_order(llist_del_all(&chnl->incoming));
+   
+   llist_for_each_entry_safe(data, next, first, node)
+      enqueue(chnl, data);
+}
+
+
+/**
+ * A sender which raced with qnx_channel_destroy takes back what is still 
+ * incoming. Its own messages (first ... last) are moved to @c own, the ones
+ * of other senders are failed here. 
+ *
+ * @return 1 if the own messages were found, 0 if the destroying thread 
+ *         already took them and fails them
+ */
+static
+int reclaim_incoming(struct qnx_channel* chnl, struct llist_node* first, struct llist_node* last, struct list_head* own)
+{
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+   struct llist_node* all;
+   int found = 0;
+   int is_own = 0;
+   
+   LIST_HEAD(others);
+   
+   // the lock orders this against the take within qnx_channel_destroy
+   spin_lock(&chnl->waiting_lock);
+   all = llist_del_all(&chnl->incoming);
+   spin_unlock(&chnl->waiting_lock);
+   
+   // still newest first, so the own chain starts at first and ends at last
+   llist_for_each_entry_safe(data, next, all, node)
+   {
+      if (&data->node == first)
+      {
+         is_own = 1;
+         found = 1;
+      }
+      
+      if (is_own)
+      {
+         list_add(&data->hook, own);
+      }
+      else
+      {
+         data->state = QNX_STATE_RECEIVING;
+         list_add(&data->hook, &others);
+      }
+      
+      if (&data->node == last)
+         is_own = 0;
+   }
+   
+   qnx_internal_msgsend_cleanup_and_free_all(&others);
+   
+   return found;
+}
+
+
+/// lock-free enqueue of a chain of messages (newest first)
+static
+int push_incoming(struct qnx_channel* chnl, struct llist_node* first, struct llist_node* last, int num, struct list_head* own)
+{
+   llist_add_batch(first, last, &chnl->incoming);
+   atomic_add(num, &chnl->num_waiting);
+   
+   // pairs with the barrier in qnx_channel_destroy
+   smp_mb();
+   
+   if (unlikely(ACCESS_ONCE(chnl->destroyed)) && reclaim_incoming(chnl, first, last, own))
+      return -ESRCH;
+   
+   return 0;
+}
+
+
+/// the lock based variant, see module parameter lockfree_enqueue
+static
+int add_new_message_locked(struct qnx_channel* chnl, struct qnx_internal_msgsend* data)
 {
    int rc = 0;
-   data->receiver_chid = chnl->chid;
    
    spin_lock(&chnl->waiting_lock);   
    
-   // normal message or pulse
-   if (likely(data->rcvid == 0 || data->task != 0)) 
+   if (unlikely(chnl->destroyed))
+   {
+      rc = -ESRCH;
+   }
+   else if (unlikely(is_noreply(data)) && !reserve_noreply(chnl))
    {
-      list_add_tail(&data->hook, &chnl->waiting); 
+      rc = -EAGAIN;
    }
    else
-   { 
-      // noreply message
-      if (likely(chnl->num_waiting_noreply < qnx_max_noreply_msg_num))
-      {      
-         list_add_tail(&data->hook, &chnl->waiting); 
-         ++chnl->num_waiting_noreply;         
+   {
+      // keep the order with respect to messages enqueued lock-free before
+      qnx_channel_take_incoming(chnl);
+      
+      enqueue(chnl, data);
+      atomic_inc(&chnl->num_waiting);
+   }
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   return rc;
+}
+
+
+static
+int same_pulse(const struct qnx_internal_msgsend* queued, const void* arg)
+{
+   const struct qnx_internal_msgsend* data = (const struct qnx_internal_msgsend*)arg;
+   
+   return queued->rcvid == 0 
+      && queued->sender_pid == data->sender_pid
+      && queued->data.pulse.coid == data->data.pulse.coid
+      && queued->data.pulse.code == data->data.pulse.code;
+}
+
+
+/**
+ * The lock based enqueue of a channel created with QNX_CHF_COALESCE_PULSES.
+ * A pulse still queued with the same connection, code and priority takes
+ * over the new value, the new descriptor is freed. 
+ *
+ * @return as qnx_channel_add_new_messages, merged pulses count as added
+ */
+static
+int add_new_messages_coalesced(struct qnx_channel* chnl, struct list_head* msgs)
+{
+   int rc = 0;
+   int queued = 0;
+   int pulses = 0;
+   pid_t pid = 0;
+   int coid = 0;
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+   struct qnx_internal_msgsend* found;
+   
+   LIST_HEAD(merged);
+   
+   spin_lock(&chnl->waiting_lock);
+   
+   if (unlikely(chnl->destroyed))
+   {
+      spin_unlock(&chnl->waiting_lock);
+      return -ESRCH;
+   }
+   
+   // the lookup must see all queued pulses
+   qnx_channel_take_incoming(chnl);
+   
+   list_for_each_entry_safe(data, next, msgs, hook)
+   {
+      if (is_noreply(data) && unlikely(!reserve_noreply(chnl)))
+         break;
+         
+      data->receiver_chid = chnl->chid;
+      list_del(&data->hook);
+      
+      found = data->rcvid == 0 ? qnx_msg_queue_find(&chnl->pulse_queue, data->priority, &same_pulse, data) : 0;
+      
+      if (found)
+      {
+         found->data.pulse.value = data->data.pulse.value;
+         list_add_tail(&data->hook, &merged);
       }
       else
-         rc = -1;
+      {
+         pid = data->sender_pid;
+         coid = qnx_internal_msgsend_coid(data);
+         
+         if (data->rcvid == 0)
+            ++pulses;
+            
+         enqueue(chnl, data);
+         ++queued;
+      }
+      
+      ++rc;
    }
    
-   atomic_inc(&chnl->num_waiting);
+   atomic_add(queued, &chnl->num_waiting);
+   
    spin_unlock(&chnl->waiting_lock);
    
-   wake_up(&chnl->waiting_queue);
+   list_for_each_entry_safe(data, next, &merged, hook)
+   {
+      qnx_internal_msgsend_free(data);
+   }
+   
+   if (queued)
+      qnx_channel_wake_receivers(chnl, pid, coid, queued - pulses, pulses, 0);
+   
+   return rc;
+}
+
+
+int qnx_channel_add_new_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data)
+{
+   int rc = 0;
+   
+   LIST_HEAD(own);
+   
+   data->receiver_chid = chnl->chid;
+   
+   if (unlikely(chnl->flags & QNX_CHF_COALESCE_PULSES) && data->rcvid == 0)
+   {
+      // the list is only used for the call, the pulse may be gone afterwards
+      list_add(&data->hook, &own);
+      
+      rc = add_new_messages_coalesced(chnl, &own);
+      return rc < 0 ? rc : 0;
+   }
+   
+   if (unlikely(!qnx_lockfree_enqueue))
+   {
+      rc = add_new_message_locked(chnl, data);
+   }
+   else if (unlikely(ACCESS_ONCE(chnl->destroyed)))
+   {
+      rc = -ESRCH;
+   }
+   else if (unlikely(is_noreply(data)) && !reserve_noreply(chnl))
+   {
+      rc = -EAGAIN;
+   }
+   else
+      rc = push_incoming(chnl, &data->node, &data->node, 1, &own);
+   
+   // a blocking sender is going to sleep, so the receiver may run on this cpu
+   if (likely(rc == 0))
+      qnx_channel_wake_receivers(chnl, data->sender_pid, qnx_internal_msgsend_coid(data), 
+                                 data->rcvid != 0, data->rcvid == 0, data->task != 0);
+   
+   return rc;
+}
+
+
+int qnx_channel_add_new_messages(struct qnx_channel* chnl, struct list_head* msgs)
+{
+   int rc = 0;
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+   struct llist_node* first = 0;
+   struct llist_node* last = 0;
+   pid_t pid = 0;
+   int coid = 0;
+   int pulses = 0;
+   
+   LIST_HEAD(own);
+   
+   if (unlikely(chnl->flags & QNX_CHF_COALESCE_PULSES))
+      return add_new_messages_coalesced(chnl, msgs);
+      
+   if (unlikely(ACCESS_ONCE(chnl->destroyed)))
+      return -ESRCH;
+   
+   // build the chain newest first
+   list_for_each_entry_safe(data, next, msgs, hook)
+   {
+      if (is_noreply(data) && unlikely(!reserve_noreply(chnl)))
+         break;
+      
+      data->receiver_chid = chnl->chid;
+      list_del(&data->hook);
+      
+      data->node.next = first;
+      first = &data->node;
+      
+      if (!last)
+         last = first;
+      
+      pid = data->sender_pid;
+      coid = qnx_internal_msgsend_coid(data);
+      
+      if (data->rcvid == 0)
+         ++pulses;
+      
+      ++rc;
+   }
+   
+   if (unlikely(rc == 0))
+      return 0;
+      
+   if (unlikely(!qnx_lockfree_enqueue))
+   {
+      spin_lock(&chnl->waiting_lock);
+      
+      // the same order as with the lock-free push
+      llist_add_batch(first, last, &chnl->incoming);
+      atomic_add(rc, &chnl->num_waiting);
+      qnx_channel_take_incoming(chnl);
+      
+      spin_unlock(&chnl->waiting_lock);
+   }
+   else if (unlikely(push_incoming(chnl, first, last, rc, &own)))
+   {
+      // give them back in the original order
+      list_splice(&own, msgs);
+      return -ESRCH;
+   }
+   
+   qnx_channel_wake_receivers(chnl, pid, coid, rc - pulses, pulses, 0);
+   
+   return rc;
+}
+
+
+/// wakes up blocked noreply senders and fires the notifications below the low watermark
+void qnx_channel_noreply_consumed(struct qnx_channel* chnl)
+{
+   struct qnx_noreply_notify* notify;
+   struct qnx_noreply_notify* next;
+   
+   LIST_HEAD(notifications);
+   
+   // arming checks the fill level under the lock, so a stale empty list is fine here
+   if (unlikely(!list_empty(&chnl->noreply_notify)))
+   {
+      spin_lock(&chnl->waiting_lock);
+      
+      if (atomic_read(&chnl->num_waiting_noreply) < noreply_low_watermark())
+         list_splice_init(&chnl->noreply_notify, &notifications);
+      
+      spin_unlock(&chnl->waiting_lock);
+      
+      list_for_each_entry_safe(notify, next, &notifications, hook)
+         qnx_noreply_notify_fire(notify);
+   }
+   
+   // pairs with the barrier within prepare_to_wait of the senders
+   smp_mb();
+   
+   if (waitqueue_active(&chnl->space_queue))
+      wake_up_interruptible(&chnl->space_queue);
+}
+
+
+int qnx_channel_add_noreply_notify(struct qnx_channel* chnl, struct qnx_noreply_notify* notify)
+{
+   int rc = 0;
+   int fire = 0;
+   
+   spin_lock(&chnl->waiting_lock);
+   
+   if (unlikely(chnl->destroyed))
+   {
+      rc = -ESRCH;
+   }
+   else if (atomic_read(&chnl->num_waiting_noreply) < noreply_low_watermark())
+   {
+      fire = 1;
+   }
+   else
+      list_add_tail(&notify->hook, &chnl->noreply_notify);
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   if (fire)
+      qnx_noreply_notify_fire(notify);
    
    return rc;
 }
@@ -102,26 +616,317 @@ int qnx_channel_add_new_message(struct qnx_channel* chnl, struct qnx_internal_ms
  * This is only called for normal messages, therefore no check for pulse
  * or noreply messages in here.
  */
-int qnx_channel_remove_message(struct qnx_channel* chnl, int rcvid)
+int qnx_channel_cancel_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data)
 {
    int rc = 0;
-   struct list_head* iter;
    
    spin_lock(&chnl->waiting_lock);
    
-   list_for_each(iter, &chnl->waiting)
+   // the message might still be on the incoming list
+   qnx_channel_take_incoming(chnl);
+   
+   // receivers change the state under the lock, too
+   if (data->state == QNX_STATE_INITIAL)
+   {
+      qnx_msg_queue_remove(&chnl->waiting, data);
+      atomic_dec(&chnl->num_waiting);         
+      
+      rc = 1;
+   }
+
+   spin_unlock(&chnl->waiting_lock);
+   
+   return rc;
+}
+
+
+/// a pulse may be received by either kind of receiver
+static inline
+void wake_pulse_receiver(struct qnx_channel* chnl, pid_t pid, int coid, int sync)
+{
+   if (!qnx_idle_receivers_wake(&chnl->pulse_receivers, pid, coid, sync))
+      qnx_idle_receivers_wake(&chnl->receivers, pid, coid, sync);
+}
+
+
+int qnx_channel_wait_for_messages(struct qnx_channel* chnl, int pulses, ktime_t timeout)
+{
+   int rc = 0;
+   struct qnx_idle_receiver rcv;
+   
+   struct qnx_idle_receivers* receivers = pulses ? &chnl->pulse_receivers : &chnl->receivers;
+   int (*has_messages)(struct qnx_channel*) = pulses ? &qnx_channel_has_pulses : &qnx_channel_has_messages;
+   
+   if (has_messages(chnl))
+      return 0;
+      
+   qnx_idle_receivers_add(receivers, &rcv);
+   
+   if (!has_messages(chnl))
+      rc = wait_event_interruptible_hrtimeout(rcv.wq, ACCESS_ONCE(rcv.woken), timeout);
+   
+   // the wakeup raced with a signal or the timeout, pass it on
+   if (qnx_idle_receivers_remove(receivers, &rcv) && rc != 0)
    {
-      if (list_entry(iter, struct qnx_internal_msgsend, hook)->rcvid == rcvid)
+      if (pulses)
       {
-         list_del(iter);
-         atomic_dec(&chnl->num_waiting);         
-         
+         wake_pulse_receiver(chnl, 0, 0, 0);
+      }
+      else
+         qnx_idle_receivers_wake(receivers, 0, 0, 0);
+   }
+      
+   return rc;
+}
+
+
+void qnx_channel_wake_receivers(struct qnx_channel* chnl, pid_t pid, int coid, int num, int num_pulses, int sync)
+{
+   int i;
+   
+   for (i=0; i<num; ++i)
+      qnx_idle_receivers_wake(&chnl->receivers, pid, coid, sync);
+      
+   for (i=0; i<num_pulses; ++i)
+      wake_pulse_receiver(chnl, pid, coid, sync);
+      
+   // the barrier within qnx_idle_receivers_wake makes the message visible to waitqueue_active
+   if (waitqueue_active(&chnl->waiting_queue))
+      wake_up(&chnl->waiting_queue);
+}
+
+
+int qnx_channel_has_messages(struct qnx_channel* chnl)
+{
+   int rc = 0;
+   struct qnx_submit_ring* ring;
+   
+   if (atomic_read(&chnl->num_waiting) > 0)
+      return 1;
+      
+   if (likely(list_empty(&chnl->rings)))
+      return 0;
+      
+   spin_lock(&chnl->waiting_lock);
+   
+   list_for_each_entry(ring, &chnl->rings, chnl_hook)
+   {
+      if (qnx_submit_ring_arm(ring))
          rc = 1;
+   }
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   return rc;
+}
+
+
+int qnx_channel_has_pulses(struct qnx_channel* chnl)
+{
+   int rc;
+   struct qnx_submit_ring* ring;
+   
+   if (atomic_read(&chnl->num_waiting) == 0 && likely(list_empty(&chnl->rings)))
+      return 0;
+      
+   spin_lock(&chnl->waiting_lock);
+   
+   qnx_channel_take_incoming(chnl);
+   rc = !qnx_msg_queue_empty(&chnl->pulse_queue);
+   
+   // the entries might be pulses, MsgReceivePulse flushes the rings
+   if (!rc)
+   {
+      list_for_each_entry(ring, &chnl->rings, chnl_hook)
+      {
+         if (qnx_submit_ring_arm(ring))
+            rc = 1;
+      }
+   }
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   return rc;
+}
+
+
+struct qnx_internal_msgsend* qnx_channel_first_message(struct qnx_channel* chnl, int pulses)
+{
+   struct qnx_internal_msgsend* pulse = qnx_msg_queue_first(&chnl->pulse_queue);
+   struct qnx_internal_msgsend* msg;
+   
+   if (pulses)
+      return pulse;
+      
+   msg = qnx_msg_queue_first(&chnl->waiting);
+   
+   if (!pulse)
+      return msg;
+      
+   if (!msg)
+      return pulse;
+   
+   // higher priority first, then in the order they were queued
+   if (pulse->priority != msg->priority)
+      return pulse->priority > msg->priority ? pulse : msg;
+   
+   return (s32)(pulse->seq - msg->seq) < 0 ? pulse : msg;
+}
+
+
+void qnx_channel_remove_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data)
+{
+   if (data->rcvid == 0)
+   {
+      qnx_msg_queue_remove(&chnl->pulse_queue, data);
+   }
+   else
+   {
+      qnx_msg_queue_remove(&chnl->waiting, data);
+      
+      if (!data->task)
+         atomic_dec(&chnl->num_waiting_noreply);
+   }
+   
+   atomic_dec(&chnl->num_waiting);
+}
+
+
+void qnx_channel_add_ring(struct qnx_channel* chnl, struct qnx_submit_ring* ring)
+{
+   spin_lock(&chnl->waiting_lock);
+   
+   // else it would never be dropped, see qnx_channel_destroy
+   if (likely(!chnl->destroyed))
+   {
+      kref_get(&ring->refcnt);
+      list_add_tail(&ring->chnl_hook, &chnl->rings);
+   }
+   
+   spin_unlock(&chnl->waiting_lock);
+}
+
+
+void qnx_channel_remove_ring(struct qnx_channel* chnl, struct qnx_submit_ring* ring)
+{
+   int found = 0;
+   
+   spin_lock(&chnl->waiting_lock);
+   
+   // the channel may have dropped it already when it was destroyed
+   if (!list_empty(&ring->chnl_hook))
+   {
+      list_del_init(&ring->chnl_hook);
+      found = 1;
+   }
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   if (found)
+      qnx_submit_ring_release(ring);
+}
+
+
+struct qnx_submit_ring* qnx_channel_next_ring(struct qnx_channel* chnl)
+{
+   struct qnx_submit_ring* ring;
+   
+   list_for_each_entry(ring, &chnl->rings, chnl_hook)
+   {
+      if (qnx_submit_ring_pending(ring))
+      {
+         // round robin, so one busy sender can't starve the others
+         list_move_tail(&ring->chnl_hook, &chnl->rings);
+         return ring;
+      }
+   }
+   
+   return 0;
+}
+
+
+void qnx_channel_flush_ring(struct qnx_channel* chnl, struct qnx_submit_ring* ring)
+{
+   struct qnx_internal_msgsend* data = 0;
+   int flushed = 0;
+   int pulses = 0;
+   
+   // a concurrent sender must not keep us here forever
+   while (flushed < QNX_RING_SLOTS)
+   {
+      if (!data)
+      {
+         data = qnx_internal_msgsend_alloc();
+         if (unlikely(!data))
+            break;
+      }
+      
+      spin_lock(&chnl->waiting_lock);
+      
+      if (list_empty(&ring->chnl_hook) || !qnx_submit_ring_pending(ring))
+      {
+         spin_unlock(&chnl->waiting_lock);
          break;
       }
+      
+      qnx_internal_msgsend_init_ring(data, ring);
+      data->receiver_chid = chnl->chid;
+      
+      // not subject to the noreply limit, the messages were accepted already
+      if (data->rcvid > 0)
+      {
+         atomic_inc(&chnl->num_waiting_noreply);
+      }
+      else
+         ++pulses;
+         
+      qnx_channel_take_incoming(chnl);
+      enqueue(chnl, data);
+      atomic_inc(&chnl->num_waiting);
+      
+      spin_unlock(&chnl->waiting_lock);
+      
+      data = 0;
+      ++flushed;
    }
+   
+   if (data)
+      qnx_internal_msgsend_free(data);
+      
+   if (flushed)
+      qnx_channel_wake_receivers(chnl, ring->sender_pid, ring->coid, flushed - pulses, pulses, 0);
+}
 
+
+void qnx_channel_flush_rings(struct qnx_channel* chnl)
+{
+   struct qnx_submit_ring* ring;
+   int num_rings = 0;
+   int i;
+   
+   spin_lock(&chnl->waiting_lock);
+   
+   list_for_each_entry(ring, &chnl->rings, chnl_hook)
+   {
+      ++num_rings;
+   }
+   
    spin_unlock(&chnl->waiting_lock);
    
-   return rc;
+   for (i=0; i<num_rings; ++i)
+   {
+      spin_lock(&chnl->waiting_lock);
+      
+      ring = qnx_channel_next_ring(chnl);
+      if (ring)
+         kref_get(&ring->refcnt);
+         
+      spin_unlock(&chnl->waiting_lock);
+      
+      if (!ring)
+         break;
+         
+      qnx_channel_flush_ring(chnl, ring);
+      qnx_submit_ring_release(ring);
+   }
 }
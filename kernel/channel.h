@@ -5,11 +5,19 @@
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/kref.h>
+#include <linux/rcupdate.h>
 #include <linux/wait.h>
+#include <linux/llist.h>
+
+#include "msg_queue.h"
+#include "idle_receivers.h"
+#include "pulse_pool.h"
 
 
 // forward decls
 struct qnx_internal_msgsend;
+struct qnx_msgsend_pool;
+struct qnx_submit_ring;
 
 
 struct qnx_channel
@@ -17,14 +25,44 @@ struct qnx_channel
    struct list_head hook;
    struct kref refcnt;
       
-   int chid;
+   int chid;                 ///< assigned by the driver's channel registry
+   pid_t pid;                ///< owner
+   unsigned int flags;       ///< ChannelCreate flags
+   
+   struct llist_head incoming;     ///< lock-free enqueue, receivers move the messages to waiting
    
-   struct list_head waiting;
+   struct qnx_msg_queue waiting;   ///< received by priority, FIFO within a priority
+   struct qnx_msg_queue pulse_queue;   ///< the same for pulses, so MsgReceivePulse doesn't search the messages
+   u32 next_seq;                   ///< keeps the order between both queues
    spinlock_t waiting_lock;
    
-   wait_queue_head_t waiting_queue;
-   atomic_t num_waiting;     ///< wait queue helper flag
-   int num_waiting_noreply;
+   wait_queue_head_t waiting_queue;   ///< pollers only, see receivers
+   struct qnx_idle_receivers receivers;
+   struct qnx_idle_receivers pulse_receivers;   ///< threads within MsgReceivePulse
+   atomic_t num_waiting;     ///< wait queue helper flag, counts incoming and waiting messages
+   atomic_t num_waiting_noreply;   ///< reserved by the senders, given back by the receivers
+   
+   struct qnx_msgsend_pool* noreply_pool;   ///< preallocated noreply messages, 0 if not requested
+   struct qnx_pulse_pool pulses;            ///< descriptors of the pulses sent here
+   
+   struct list_head rings;   ///< submission rings of connected senders, protected by waiting_lock
+   
+   wait_queue_head_t space_queue;   ///< noreply senders wait here for a free slot
+   struct list_head noreply_notify; ///< armed low watermark notifications, protected by waiting_lock
+   
+   int destroyed;            ///< set when the owner drops the channel, connections may still hold a reference
+   
+   struct rcu_head rcu;      ///< the memory is freed after a grace period, see qnx_connection_table_get_channel
+};
+
+
+/// one-shot pulse sent when the channel's noreply queue drains below the low watermark
+struct qnx_noreply_notify
+{
+   struct list_head hook;
+   
+   struct qnx_channel* chnl;               ///< the pulse goes here, holds a reference
+   struct qnx_internal_msgsend* pulse;
 };
 
 
@@ -32,15 +70,73 @@ struct qnx_channel
 
 
 /// construction/destruction
-int qnx_channel_init(struct qnx_channel* chnl);
+int qnx_channel_init(struct qnx_channel* chnl, unsigned int flags, pid_t pid);
 
 void qnx_channel_release(struct qnx_channel* chnl);
 
+/// called when the owner drops the channel, fails all future messages. The queued
+/// messages are moved to @c queued, the caller fails them before releasing the channel.
+void qnx_channel_destroy(struct qnx_channel* chnl, struct list_head* queued);
+
 
-/// messages management
+/// messages management, returns -EAGAIN if the noreply limit is reached or -ESRCH if the channel is destroyed
 int qnx_channel_add_new_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data);
 
-int qnx_channel_remove_message(struct qnx_channel* chnl, int rcvid);
+/// moves as many messages as the noreply limit allows, returns the number of messages moved or -ESRCH
+int qnx_channel_add_new_messages(struct qnx_channel* chnl, struct list_head* msgs);
+
+/// called by receivers after noreply messages were taken and freed, wakes up blocked 
+/// noreply senders and fires the low watermark notifications
+void qnx_channel_noreply_consumed(struct qnx_channel* chnl);
+
+/// arms the notification, it fires immediately if the queue is already below the low watermark
+int qnx_channel_add_noreply_notify(struct qnx_channel* chnl, struct qnx_noreply_notify* notify);
+
+/// must be called with waiting_lock held, moves the incoming messages to the waiting queue
+void qnx_channel_take_incoming(struct qnx_channel* chnl);
+
+/// takes a blocking request out of the queue, returns 0 if it was already taken by a receiver
+int qnx_channel_cancel_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data);
+
+/// wait condition for receivers, arms the submission rings if there is nothing to do
+int qnx_channel_has_messages(struct qnx_channel* chnl);
+
+/// the same for MsgReceivePulse, a submission ring with entries counts as well
+int qnx_channel_has_pulses(struct qnx_channel* chnl);
+
+/**
+ * Waits until there are messages (or pulses only), the result is as for 
+ * wait_event_interruptible_hrtimeout. Messages may be taken by another 
+ * receiver before the caller gets the lock, then simply wait again.
+ */
+int qnx_channel_wait_for_messages(struct qnx_channel* chnl, int pulses, ktime_t timeout);
+
+/**
+ * Wakes up a receiver for each of @c num messages and @c num_pulses pulses 
+ * of the given connection and all pollers. Pulses go to MsgReceivePulse 
+ * threads first.
+ */
+void qnx_channel_wake_receivers(struct qnx_channel* chnl, pid_t pid, int coid, int num, int num_pulses, int sync);
+
+/// must be called with waiting_lock held, the next message to receive (or pulse only), 0 if there is none
+struct qnx_internal_msgsend* qnx_channel_first_message(struct qnx_channel* chnl, int pulses);
+
+/// must be called with waiting_lock held, takes a queued message out for receiving
+void qnx_channel_remove_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* data);
+
+
+/// submission rings management, a destroyed channel drops its rings and doesn't take new ones
+void qnx_channel_add_ring(struct qnx_channel* chnl, struct qnx_submit_ring* ring);
+
+void qnx_channel_remove_ring(struct qnx_channel* chnl, struct qnx_submit_ring* ring);
+
+/// must be called with waiting_lock held, returns 0 if all rings are empty
+struct qnx_submit_ring* qnx_channel_next_ring(struct qnx_channel* chnl);
+
+/// moves the ring's pending entries to the waiting list
+void qnx_channel_flush_ring(struct qnx_channel* chnl, struct qnx_submit_ring* ring);
+
+void qnx_channel_flush_rings(struct qnx_channel* chnl);
 
 
 #endif   // __QNXCOMM_CHANNEL_H
@@ -4,54 +4,53 @@
 
 #include <asm/uaccess.h>
 #include <linux/version.h>
-
-
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(3,2,0)
-
-static
-int memcpy_toiovec(struct iovec *iov, unsigned char *kdata, int len)
-{
-         while (len > 0) {
-                 if (iov->iov_len) {
-                         int copy = min_t(unsigned int, iov->iov_len, len);
-                         if (copy_to_user(iov->iov_base, kdata, copy))
-                                 return -EFAULT;
-                         kdata += copy;
-                         len -= copy;
-                         iov->iov_len -= copy;
-                         iov->iov_base += copy;
-                 }
-                 iov++;
-         }
- 
-         return 0;
-}
-
-
-static 
-int memcpy_fromiovec(unsigned char *kdata, struct iovec *iov, int len)
+#include <linux/mm.h>
+#include <linux/sched.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#   include <linux/sched/task.h>
+#   include <linux/sched/types.h>
+#endif
+
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+#   define qnx_mmap_read_lock(mm)   down_read(&(mm)->mmap_sem)
+#   define qnx_mmap_read_unlock(mm) up_read(&(mm)->mmap_sem)
+#else
+#   define qnx_mmap_read_lock(mm)   mmap_read_lock(mm)
+#   define qnx_mmap_read_unlock(mm) mmap_read_unlock(mm)
+#endif
+
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
+#   define qnx_vm_flags_set(vma, flags) ((vma)->vm_flags |= (flags))
+#else
+#   define qnx_vm_flags_set(vma, flags) vm_flags_set(vma, flags)
+#endif
+
+
+/**
+ * Pin pages of a foreign address space. The caller must hold the 
+ * mmap lock for reading.
+ */
+static inline
+long qnx_get_user_pages_remote(struct task_struct* task, struct mm_struct* mm, unsigned long start, 
+                               unsigned long nr_pages, int write, struct page** pages)
 {
-   while (len > 0) 
-   {
-      if (iov->iov_len) 
-      {
-         int copy = min_t(unsigned int, len, iov->iov_len);
-         if (copy_from_user(kdata, iov->iov_base, copy))
-            return -EFAULT;
-            
-         len -= copy;
-         kdata += copy;
-         iov->iov_base += copy;
-         iov->iov_len -= copy;
-      }
-      
-      iov++;
-   }
-
-   return 0;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,6,0)
+   return get_user_pages(task, mm, start, nr_pages, write, 0, pages, 0);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(4,9,0)
+   return get_user_pages_remote(task, mm, start, nr_pages, write, 0, pages, 0);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(4,10,0)
+   return get_user_pages_remote(task, mm, start, nr_pages, write ? FOLL_WRITE : 0, pages, 0);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0)
+   return get_user_pages_remote(task, mm, start, nr_pages, write ? FOLL_WRITE : 0, pages, 0, 0);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(6,5,0)
+   return get_user_pages_remote(mm, start, nr_pages, write ? FOLL_WRITE : 0, pages, 0, 0);
+#else
+   return get_user_pages_remote(mm, start, nr_pages, write ? FOLL_WRITE : 0, pages, 0);
+#endif
 }
 
-#endif   // LINUX_VERSION_CODE <= KERNEL_VERSION(3,2,0)
-
 
 #endif   // QNXCOMM_COMPATIBILITY_H
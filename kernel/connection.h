@@ -3,24 +3,37 @@
 
 
 #include <linux/types.h>
+#include <linux/rcupdate.h>
+
+
+// forward decl
+struct qnx_channel;
 
 
 struct qnx_connection
 {
    pid_t pid;   ///< the real pid, not the task id (i.e. the tgid)
    int chid;    ///< the chid the connection is connected to...
+   int flags;   ///< ConnectAttach flags
+   
+   struct qnx_channel* chnl;   ///< resolved during ConnectAttach, holds a reference
+   
+   struct rcu_head rcu;        ///< deferred freeing after ConnectDetach
 };
 
 
 // ---------------------------------------------------------------------
 
 
+/// takes over the channel reference
 static inline
-void qnx_connection_init(struct qnx_connection* conn, pid_t pid, int chid)
+void qnx_connection_init(struct qnx_connection* conn, pid_t pid, int chid, int flags, struct qnx_channel* chnl)
 {
    // target channel information
    conn->pid = pid;
    conn->chid = chid;
+   conn->flags = flags;
+   conn->chnl = chnl;
 }
 
 
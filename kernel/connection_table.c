@@ -2,8 +2,10 @@
 
 #include <linux/fs.h>
 #include <linux/slab.h>
+#include <linux/bitops.h>
 
 #include "qnxcomm_internal.h"
+#include "channel.h"
 
 
 #define QNX_INITIAL_TABLE_SIZE 64
@@ -24,41 +26,76 @@ int qnx_connection_table_get_max(struct qnx_connection_table* table)
 
 
 static
-int qnx_connection_table_reserve_unlocked(struct qnx_connection_table* table, int newsize)
+struct qnx_connection_table_data* qnx_connection_table_data_alloc(size_t capacity)
+{
+   struct qnx_connection_table_data* data;
+   
+   data = (struct qnx_connection_table_data*)kzalloc(sizeof(struct qnx_connection_table_data) 
+         + sizeof(struct qnx_connection*) * capacity /*exactly -1*/
+         + sizeof(unsigned long) * BITS_TO_LONGS(capacity), GFP_USER);   
+   
+   if (likely(data))
+   {
+      data->capacity = capacity;
+      data->used = (unsigned long*)(data->conn + capacity);
+      
+      // coid 0 is never handed out
+      __set_bit(0, data->used);
+   }
+   
+   return data;
+}
+
+
+/**
+ * Allocates the next bigger table without holding the lock. If somebody else
+ * was faster, the new table is thrown away and the caller simply retries.
+ * The old table is freed after a grace period, readers may still use it.
+ */
+static
+int qnx_connection_table_grow(struct qnx_connection_table* table, size_t oldsize)
 {
    struct qnx_connection_table_data* old;
    struct qnx_connection_table_data* new;
    
-   int oldsize = qnx_connection_table_get_capacity(table);
+   size_t newsize = oldsize ? oldsize << 1 : QNX_INITIAL_TABLE_SIZE;
    
    if (unlikely(newsize > qnx_max_connections_per_process))
       return -EMFILE;
-      
-   if (likely(newsize <= oldsize))
-      return oldsize;
-      
-   old = table->data;
    
-   new = (struct qnx_connection_table_data*)kmalloc(sizeof(struct qnx_connection_table_data) 
-         + sizeof(struct qnx_connection*) * newsize /*exactly -1*/, GFP_USER);   
-      
+   new = qnx_connection_table_data_alloc(newsize);
+   
    if (unlikely(!new))
       return -ENOMEM;
    
-   if (oldsize > 0)
-      memcpy(new->conn, old->conn, sizeof(struct qnx_connection*) * oldsize);
+   spin_lock(&table->lock);
    
-   memset(new->conn + oldsize, 0, sizeof(struct qnx_connection*) * (newsize - oldsize));
+   old = table->data;
    
-   new->capacity = newsize; 
-   new->max = 0;
+   if (likely(qnx_connection_table_get_capacity(table) == oldsize))
+   {
+      if (old)
+      {
+         memcpy(new->conn, old->conn, sizeof(struct qnx_connection*) * oldsize);
+         memcpy(new->used, old->used, sizeof(unsigned long) * BITS_TO_LONGS(oldsize));
+         
+         new->max = old->max;
+      }
+      
+      rcu_assign_pointer(table->data, new);
+      new = 0;
+   }
+   else
+      old = 0;
+   
+   spin_unlock(&table->lock);
    
-   rcu_assign_pointer(table->data, new);   
+   kfree(new);
    
-   synchronize_rcu();
-   kfree(old);
+   if (old)
+      kfree_rcu(old, rcu);
    
-   return oldsize;
+   return 0;
 }
 
 
@@ -67,14 +104,11 @@ int qnx_connection_table_reserve_unlocked(struct qnx_connection_table* table, in
 
 int qnx_connection_table_init(struct qnx_connection_table* table)
 {
-   int rc;
-      
    table->data = 0;
    
    spin_lock_init(&table->lock);
    
-   rc = qnx_connection_table_reserve_unlocked(table, QNX_INITIAL_TABLE_SIZE);
-   return rc > 0 ? 0 : rc;
+   return qnx_connection_table_grow(table, 0);
 }
 
 
@@ -82,50 +116,58 @@ void qnx_connection_table_destroy(struct qnx_connection_table* table)
 {
    int i;
    
-   for(i=0; i < qnx_connection_table_get_max(table); ++i)
+   for(i=0; i <= qnx_connection_table_get_max(table); ++i)
    {
       if (table->data->conn[i])
-         kfree(table->data->conn[i]);
+      {
+         qnx_channel_release(table->data->conn[i]->chnl);
+         kfree_rcu(table->data->conn[i], rcu);
+      }
    }
    
-   kfree(table->data);
+   // /proc readers may still walk the table
+   kfree_rcu(table->data, rcu);
 }
 
 
 int qnx_connection_table_add(struct qnx_connection_table* table, struct qnx_connection* conn)
 {
    int rc = 0;
-   int i;
+   size_t capacity;
    
-   spin_lock(&table->lock);
-      
-   for(i=1; i<qnx_connection_table_get_capacity(table); ++i)
+   while(likely(rc == 0))
    {
-      if (!table->data->conn[i])
+      struct qnx_connection_table_data* data;
+      
+      spin_lock(&table->lock);
+      
+      data = table->data;
+      capacity = data->capacity;
+      
+      rc = find_next_zero_bit(data->used, capacity, 1);
+      
+      if (likely(rc < capacity))
       {
-         rcu_assign_pointer(table->data->conn[i], conn);
-         rc = i;
+         __set_bit(rc, data->used);
+         rcu_assign_pointer(data->conn[rc], conn);
          
-         break;
+         if (rc > data->max)
+            data->max = rc;
       }
-   }
-
-   if (unlikely(rc == 0))
-   {
-      rc = qnx_connection_table_reserve_unlocked(table, qnx_connection_table_get_capacity(table) << 1);
+      else
+         rc = 0;
       
-      if (likely(rc > 0))
+      spin_unlock(&table->lock);
+      
+      if (unlikely(rc == 0))
       {
-         rcu_assign_pointer(table->data->conn[table->data->capacity], conn);
-         rc = table->data->capacity;
+         rc = qnx_connection_table_grow(table, capacity);
+         
+         if (unlikely(rc < 0))
+            break;
       }
    }
    
-   if (rc > qnx_connection_table_get_max(table))
-      table->data->max = rc;
-   
-   spin_unlock(&table->lock);
-   
    return rc;
 }
 
@@ -135,36 +177,39 @@ int qnx_connection_table_remove(struct qnx_connection_table* table, int coid)
    int rc = -EINVAL;
    
    struct qnx_connection* conn = 0;
+   struct qnx_connection_table_data* data;
    
    spin_lock(&table->lock);
    
-   if (likely((size_t)coid < qnx_connection_table_get_capacity(table)))
+   data = table->data;
+   
+   if (likely(coid > 0 && (size_t)coid < data->capacity))
    {
-      conn = table->data->conn[coid];
+      conn = data->conn[coid];
    
       if (likely(conn))
       {
-         if (coid == table->data->max)
-         {
-            // assign new max fd
-            int max = coid - 1;
-            
-            while(!table->data->conn[max])
-               --max;
-            
-            table->data->max = max;
-         }
-         
          // make visible
-         rcu_assign_pointer(table->data->conn[coid], NULL);
+         rcu_assign_pointer(data->conn[coid], NULL);
+         __clear_bit(coid, data->used);
+         
+         // assign new max fd, slot 0 is always set
+         if (coid == data->max)
+            data->max = find_last_bit(data->used, coid);
+         
          rc = 0;
       }      
    }
    
    spin_unlock(&table->lock);
    
-   synchronize_rcu();
-   kfree(conn);
+   if (likely(conn))
+   {
+      // the channel itself is freed after a grace period, so readers which 
+      // still see the connection may safely try to get a reference
+      qnx_channel_release(conn->chnl);
+      kfree_rcu(conn, rcu);
+   }
    
    return rc;
 }
@@ -172,7 +217,7 @@ int qnx_connection_table_remove(struct qnx_connection_table* table, int coid)
 
 struct qnx_connection qnx_connection_table_retrieve(struct qnx_connection_table* table, int coid)
 {
-   struct qnx_connection rc = { 0 , 0 };
+   struct qnx_connection rc = { 0 };
    struct qnx_connection* conn;
    
    struct qnx_connection_table_data* data;
@@ -198,6 +243,41 @@ struct qnx_connection qnx_connection_table_retrieve(struct qnx_connection_table*
 }
 
 
+struct qnx_channel* qnx_connection_table_get_channel(struct qnx_connection_table* table, int coid, pid_t* pid, int* flags)
+{
+   struct qnx_channel* chnl = 0;
+   struct qnx_connection* conn;
+   
+   struct qnx_connection_table_data* data;
+   
+   rcu_read_lock();
+   
+   data = rcu_dereference(table->data);   
+   
+   if (likely(data && coid < data->capacity))
+   {               
+      conn = rcu_dereference(data->conn[coid]);
+      
+      // the connection's reference may already be gone, but the channel's memory is 
+      // only freed after a grace period
+      if (likely(conn && !ACCESS_ONCE(conn->chnl->destroyed) && kref_get_unless_zero(&conn->chnl->refcnt)))
+      {
+         chnl = conn->chnl;
+         
+         if (pid)
+            *pid = conn->pid;
+         
+         if (flags)
+            *flags = conn->flags;
+      }
+   }         
+   
+   rcu_read_unlock();
+   
+   return chnl;
+}
+
+
 int qnx_connection_table_is_empty(struct qnx_connection_table* table)
 {
    int rc = 1;
@@ -16,9 +16,13 @@ typedef void(*ct_callback_t)(int coid, struct qnx_connection*, void*);
 
 struct qnx_connection_table_data
 {
+   struct rcu_head rcu;
+   
    size_t capacity;   ///< capacity of conn array
    int max;           ///< maximum fd set 
    
+   unsigned long* used;   ///< bitmap of occupied slots (slot 0 is always set), located behind the conn array
+   
    struct qnx_connection* conn[1];   
 };
 
@@ -46,6 +50,10 @@ int qnx_connection_table_remove(struct qnx_connection_table* table, int coid);
 
 struct qnx_connection qnx_connection_table_retrieve(struct qnx_connection_table* table, int coid);
 
+/// returns the referenced target channel, 0 if there is no such connection or the channel was destroyed, 
+/// optionally returns the receiver's pid and the connection flags
+struct qnx_channel* qnx_connection_table_get_channel(struct qnx_connection_table* table, int coid, pid_t* pid, int* flags);
+
 
 /// these functions must only be called within a rcu_read_lock critical section.
 int qnx_connection_table_is_empty(struct qnx_connection_table* table);
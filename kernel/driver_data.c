@@ -3,11 +3,22 @@
 #include <asm/uaccess.h>
 #include <linux/sched.h>
 
+#include "channel.h"
+
 
 void qnx_driver_data_init(struct qnx_driver_data* data)
 {
-   INIT_LIST_HEAD(&data->process_entries);
+   hash_init(data->process_entries);
    spin_lock_init(&data->process_entries_lock);
+   
+   idr_init(&data->channels);
+   spin_lock_init(&data->channels_lock);
+}
+
+
+void qnx_driver_data_destroy(struct qnx_driver_data* data)
+{
+   idr_destroy(&data->channels);
 }
 
 
@@ -15,7 +26,7 @@ void qnx_driver_data_add_process(struct qnx_driver_data* data, struct qnx_proces
 {
    spin_lock(&data->process_entries_lock);
    
-   list_add_rcu(&entry->hook, &data->process_entries);
+   hash_add_rcu(data->process_entries, &entry->hook, entry->pid);
    
    spin_unlock(&data->process_entries_lock);
 }
@@ -28,14 +39,11 @@ struct qnx_process_entry* qnx_driver_data_find_process(struct qnx_driver_data* d
    
    rcu_read_lock();   
    
-   list_for_each_entry_rcu(entry, &data->process_entries, hook)
+   hash_for_each_possible_rcu(data->process_entries, entry, hook, pid)
    {
-      pr_debug("Having entry->pid=%d\n", entry->pid);
-      if (entry->pid == pid) 
-      {
-         kref_get(&entry->refcnt);
+      // the entry may already be on its way out
+      if (entry->pid == pid && kref_get_unless_zero(&entry->refcnt)) 
          goto out;
-      }
    }
    
    entry = 0;
@@ -55,7 +63,7 @@ int qnx_driver_data_is_process_available(struct qnx_driver_data* data, pid_t pid
    
    rcu_read_lock();   
    
-   list_for_each_entry_rcu(entry, &data->process_entries, hook)
+   hash_for_each_possible_rcu(data->process_entries, entry, hook, pid)
    {
       if (entry->pid == pid) 
          goto out;
@@ -72,37 +80,81 @@ out:
 
 void qnx_driver_data_remove(struct qnx_driver_data* data, pid_t pid)
 {
-   struct list_head *iter;
+   struct qnx_process_entry* entry;
 
    pr_debug("remove for pid=%d tid=%d, tgid=%d\n", pid, current->pid, current->tgid);
    
    spin_lock(&data->process_entries_lock);
    
-   list_for_each(iter, &data->process_entries) 
+   hash_for_each_possible(data->process_entries, entry, hook, pid)
    {
-      if (list_entry(iter, struct qnx_process_entry, hook)->pid == pid) 
+      if (entry->pid == pid) 
       {
-         list_del_rcu(iter);
-         
-         synchronize_rcu();         
+         hash_del_rcu(&entry->hook);
          break;
       }
    }
       
    spin_unlock(&data->process_entries_lock);
+   
+   // the entry is freed after a grace period, no need to wait for the readers
 }
 
 
-struct qnx_channel* qnx_driver_data_find_channel(struct qnx_driver_data* data, int pid, int chid)
+int qnx_driver_data_register_channel(struct qnx_driver_data* data, struct qnx_channel* chnl)
+{
+   int rc;
+   
+   idr_preload(GFP_KERNEL);
+   spin_lock(&data->channels_lock);
+   
+   // cyclic, so a stale chid does not hit a new channel too soon
+   rc = idr_alloc_cyclic(&data->channels, chnl, 1, 0, GFP_NOWAIT);
+   if (likely(rc > 0))
+      chnl->chid = rc;
+   
+   spin_unlock(&data->channels_lock);
+   idr_preload_end();
+   
+   return rc;
+}
+
+
+struct qnx_channel* qnx_driver_data_unregister_channel(struct qnx_driver_data* data, pid_t pid, int chid)
 {
-   struct qnx_channel* chnl = 0;
-   struct qnx_process_entry* proc = qnx_driver_data_find_process(data, pid);   
+   struct qnx_channel* chnl;
+   
+   spin_lock(&data->channels_lock);
    
-   if (proc)
+   chnl = (struct qnx_channel*)idr_find(&data->channels, chid);
+   if (likely(chnl && chnl->pid == pid))
    {
-      chnl = qnx_process_entry_find_channel(proc, chid);
-      qnx_process_entry_release(proc);
+      idr_remove(&data->channels, chid);
    }
+   else
+      chnl = 0;
+   
+   spin_unlock(&data->channels_lock);
+   
+   return chnl;
+}
+
+
+struct qnx_channel* qnx_driver_data_find_channel(struct qnx_driver_data* data, int pid, int chid)
+{
+   struct qnx_channel* chnl;
+   
+   if (unlikely(chid <= 0))
+      return 0;
+      
+   rcu_read_lock();
+   
+   // the owner's reference may already be gone, but the memory is freed after a grace period
+   chnl = (struct qnx_channel*)idr_find(&data->channels, chid);
+   if (unlikely(!chnl || chnl->pid != pid || !kref_get_unless_zero(&chnl->refcnt)))
+      chnl = 0;
+      
+   rcu_read_unlock();
       
    return chnl;
 }
@@ -4,6 +4,8 @@
 
 #include <linux/list.h>
 #include <linux/spinlock.h>
+#include <linux/hashtable.h>
+#include <linux/idr.h>
 
 #include "process_entry.h"
 
@@ -13,10 +15,17 @@ struct qnx_process_entry;
 struct qnx_channel;
 
 
+/// number of hash buckets for the process entries (as power of 2)
+#define QNX_PROCESS_HASH_BITS   8
+
+
 struct qnx_driver_data
 {
-   struct list_head process_entries;
-   spinlock_t process_entries_lock;   
+   DECLARE_HASHTABLE(process_entries, QNX_PROCESS_HASH_BITS);   ///< keyed by pid, RCU protected
+   spinlock_t process_entries_lock;   ///< writer side
+   
+   struct idr channels;               ///< all channels by chid, RCU protected
+   spinlock_t channels_lock;          ///< writer side
 };
 
 
@@ -25,12 +34,21 @@ struct qnx_driver_data
 
 void qnx_driver_data_init(struct qnx_driver_data* data);
 
+void qnx_driver_data_destroy(struct qnx_driver_data* data);
+
 void qnx_driver_data_add_process(struct qnx_driver_data* data, struct qnx_process_entry* entry);
 
 void qnx_driver_data_remove(struct qnx_driver_data* data, pid_t pid);
 
 struct qnx_process_entry* qnx_driver_data_find_process(struct qnx_driver_data* data, pid_t pid);
 
+/// channel registry, register assigns the chid and returns it
+int qnx_driver_data_register_channel(struct qnx_driver_data* data, struct qnx_channel* chnl);
+
+/// returns the channel if it is owned by pid, the caller takes over the registry's reference
+struct qnx_channel* qnx_driver_data_unregister_channel(struct qnx_driver_data* data, pid_t pid, int chid);
+
+/// returns the referenced channel if it is owned by pid
 struct qnx_channel* qnx_driver_data_find_channel(struct qnx_driver_data* data, int pid, int chid);
 
 int qnx_driver_data_is_process_available(struct qnx_driver_data* data, pid_t pid);
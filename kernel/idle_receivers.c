@@ -0,0 +1,122 @@
+#include "idle_receivers.h"
+
+#include <linux/sched.h>
+#include <linux/hash.h>
+
+#include "qnxcomm_driver.h"
+
+
+/// up to QNX_STICKY_SLOTS connections of a process never collide
+static inline
+unsigned int sticky_slot(pid_t pid, int coid)
+{
+   return (hash_32((u32)pid, ilog2(QNX_STICKY_SLOTS)) + (u32)coid) & (QNX_STICKY_SLOTS - 1);
+}
+
+
+void qnx_idle_receivers_init(struct qnx_idle_receivers* receivers, unsigned int flags)
+{
+   INIT_LIST_HEAD(&receivers->list);
+   spin_lock_init(&receivers->lock);
+
+   receivers->flags = flags;
+   memset(receivers->sticky, 0, sizeof(receivers->sticky));
+}
+
+
+void qnx_idle_receivers_add(struct qnx_idle_receivers* receivers, struct qnx_idle_receiver* rcv)
+{
+   rcv->task = current;
+   rcv->woken = 0;
+   init_waitqueue_head(&rcv->wq);
+
+   spin_lock(&receivers->lock);
+
+   if (receivers->flags & QNX_CHF_WAKE_LIFO)
+   {
+      list_add(&rcv->hook, &receivers->list);
+   }
+   else
+      list_add_tail(&rcv->hook, &receivers->list);
+
+   spin_unlock(&receivers->lock);
+
+   // pairs with the barrier in qnx_idle_receivers_wake, either the sender sees 
+   // us on the list or we see its message
+   smp_mb();
+}
+
+
+int qnx_idle_receivers_remove(struct qnx_idle_receivers* receivers, struct qnx_idle_receiver* rcv)
+{
+   int woken;
+
+   spin_lock(&receivers->lock);
+
+   if (!rcv->woken)
+      list_del(&rcv->hook);
+
+   woken = rcv->woken;
+
+   spin_unlock(&receivers->lock);
+
+   return woken;
+}
+
+
+int qnx_idle_receivers_wake(struct qnx_idle_receivers* receivers, pid_t pid, int coid, int sync)
+{
+   struct qnx_idle_receiver* rcv = 0;
+   struct qnx_idle_receiver* iter;
+   struct task_struct* last;
+
+   smp_mb();
+
+   if (list_empty(&receivers->list))
+      return 0;
+
+   spin_lock(&receivers->lock);
+
+   if (unlikely(list_empty(&receivers->list)))
+      goto out_unlock;
+
+   if (receivers->flags & QNX_CHF_WAKE_STICKY)
+   {
+      last = ACCESS_ONCE(receivers->sticky[sticky_slot(pid, coid)]);
+
+      list_for_each_entry(iter, &receivers->list, hook)
+      {
+         if (iter->task == last)
+         {
+            rcv = iter;
+            break;
+         }
+      }
+   }
+
+   if (!rcv)
+      rcv = list_first_entry(&receivers->list, struct qnx_idle_receiver, hook);
+
+   list_del(&rcv->hook);
+   rcv->woken = 1;
+
+   // the receiver can't leave before we drop the lock, so rcv is still valid
+   if (sync)
+   {
+      wake_up_interruptible_sync(&rcv->wq);
+   }
+   else
+      wake_up_interruptible(&rcv->wq);
+
+out_unlock:
+   spin_unlock(&receivers->lock);
+
+   return rcv != 0;
+}
+
+
+void qnx_idle_receivers_served(struct qnx_idle_receivers* receivers, pid_t pid, int coid)
+{
+   if (receivers->flags & QNX_CHF_WAKE_STICKY)
+      ACCESS_ONCE(receivers->sticky[sticky_slot(pid, coid)]) = current;
+}
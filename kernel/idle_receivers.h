@@ -0,0 +1,74 @@
+#ifndef __QNXCOMM_IDLE_RECEIVERS_H
+#define __QNXCOMM_IDLE_RECEIVERS_H
+
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/wait.h>
+
+
+// forward decls
+struct task_struct;
+
+
+/// slots remembering which thread served a connection last (QNX_CHF_WAKE_STICKY)
+#define QNX_STICKY_SLOTS 64
+
+
+/// a thread sleeping within MsgReceive, lives on the receiver's stack
+struct qnx_idle_receiver
+{
+   struct list_head hook;
+
+   struct task_struct* task;
+   wait_queue_head_t wq;       ///< only this thread sleeps here
+   int woken;                  ///< taken from the list by a sender
+};
+
+
+/**
+ * Receivers of a channel wait exclusively, so each message wakes up a single
+ * thread. Without flags the thread idle for the longest time is woken up first
+ * (FIFO), QNX_CHF_WAKE_LIFO prefers the most recently idle one. With
+ * QNX_CHF_WAKE_STICKY a message goes to the thread which served the sender's
+ * connection last if that one is idle.
+ */
+struct qnx_idle_receivers
+{
+   struct list_head list;      ///< the next thread to wake up is the first
+   spinlock_t lock;
+
+   unsigned int flags;         ///< ChannelCreate flags
+
+   /// by hash of the connection, only compared and never dereferenced
+   struct task_struct* sticky[QNX_STICKY_SLOTS];
+};
+
+
+// ---------------------------------------------------------------------
+
+
+void qnx_idle_receivers_init(struct qnx_idle_receivers* receivers, unsigned int flags);
+
+
+/// enlists the calling thread, check the wakeup condition afterwards and then wait for rcv->woken on rcv->wq
+void qnx_idle_receivers_add(struct qnx_idle_receivers* receivers, struct qnx_idle_receiver* rcv);
+
+/// delists the calling thread, returns 1 if it was woken up by a sender
+int qnx_idle_receivers_remove(struct qnx_idle_receivers* receivers, struct qnx_idle_receiver* rcv);
+
+
+/**
+ * Wakes up a single idle thread for a message of the given connection. 
+ * Call after the message is visible to receivers. If @c sync is set the
+ * caller is going to sleep, so the receiver may run on this cpu.
+ * Returns 0 if there was no idle thread.
+ */
+int qnx_idle_receivers_wake(struct qnx_idle_receivers* receivers, pid_t pid, int coid, int sync);
+
+/// remembers the calling thread as the one serving the connection (QNX_CHF_WAKE_STICKY only)
+void qnx_idle_receivers_served(struct qnx_idle_receivers* receivers, pid_t pid, int coid);
+
+
+#endif   // __QNXCOMM_IDLE_RECEIVERS_H
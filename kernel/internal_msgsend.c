@@ -2,14 +2,30 @@
 
 #include <linux/uio.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
 #include <asm/uaccess.h>
 
 #include "qnxcomm_internal.h"
+#include "remote_copy.h"
+#include "msgsend_pool.h"
+#include "pulse_pool.h"
+#include "submit_ring.h"
+#include "msg_queue.h"
 
 
 static 
 atomic_t gbl_next_rcvid = ATOMIC_INIT(0);      
 
+static
+struct kmem_cache* msgsend_cache = 0;
+
+static
+struct kmem_cache* pulse_cache = 0;
+
+/// number of heap allocations on the messaging path (statistics only)
+static
+DEFINE_PER_CPU(unsigned long, qnx_msgsend_allocations);
+
 
 static
 int get_new_rcvid(void)
@@ -18,6 +34,247 @@ int get_new_rcvid(void)
 }
 
 
+/// large payloads are not copied to the kernel, the receiver copies them directly from the sender
+static inline
+int use_direct_copy(size_t len)
+{
+   return qnx_direct_copy_min_size > 0 && len >= qnx_direct_copy_min_size;
+}
+
+
+/// small payloads are stored within the message itself, pooled messages own a payload slot
+static inline
+void* alloc_payload(struct qnx_internal_msgsend* data, size_t len)
+{
+   if (likely(len <= QNX_INLINE_MSG_SIZE))
+      return data->inline_buf;
+      
+   if (data->pool)
+      return len <= data->pool->slot_size ? qnx_msgsend_pool_payload(data->pool, data) : 0;
+      
+   this_cpu_inc(qnx_msgsend_allocations);
+   return kmalloc(len, GFP_USER);
+}
+
+
+static inline
+void free_payload(struct qnx_internal_msgsend* data)
+{
+   if (data->kbuf != data->inline_buf && !data->pool)
+      kfree(data->kbuf);
+      
+   data->kbuf = 0;
+}
+
+
+static inline
+size_t noreply_max_size(struct qnx_internal_msgsend* data)
+{
+   if (data->pool)
+      return min(data->pool->slot_size, (size_t)qnx_max_noreply_msg_size);
+      
+   return qnx_max_noreply_msg_size;
+}
+
+
+/// the calling thread's realtime priority, 0 for normal threads
+static inline
+int current_priority(void)
+{
+   return min_t(int, current->rt_priority, QNX_NUM_PRIORITIES - 1);
+}
+
+
+/// negative values select the calling thread's priority
+static inline
+int pulse_priority(int priority)
+{
+   return priority < 0 ? current_priority() : min(priority, QNX_NUM_PRIORITIES - 1);
+}
+
+
+static
+int init_noreply(struct qnx_internal_msgsend* data, int coid, const void __user* buf, size_t len, pid_t pid)
+{
+   struct qnx_msgsend_pool* pool = data->pool;
+   void* kbuf;
+   
+   if (unlikely(len > noreply_max_size(data)))         
+      return -EINVAL;      
+      
+   memset(data, 0, sizeof(struct qnx_internal_msgsend));
+   data->pool = pool;
+   
+   data->data.msg.coid = coid;
+   data->data.msg.in.iov_len = len;
+   
+   kbuf = alloc_payload(data, len);
+   if (unlikely(!kbuf))
+      return -ENOMEM;
+   
+   data->kbuf = kbuf;
+   
+   if (unlikely(copy_from_user(kbuf, buf, len)))
+      return -EFAULT;
+   
+   data->rcvid = get_new_rcvid();   
+   data->sender_pid = pid;
+   data->priority = current_priority();
+   data->state = QNX_STATE_INITIAL;
+   atomic_set(&data->readers, 0);
+   // data->task will stay zero here!
+
+   return 0;
+}
+
+
+static
+void init_pulse(struct qnx_internal_msgsend* data, int coid, int priority, int code, int value, pid_t pid)
+{
+   data->data.pulse.coid = coid;
+   data->data.pulse.code = code;
+   data->data.pulse.value = value;
+   
+   data->rcvid = 0;     // is a pulse
+   data->status = 0;
+   data->priority = pulse_priority(priority);
+   data->sender_pid = pid;
+   data->receiver_pid = 0;
+   data->task = 0;      // pulses don't have replies
+   data->state = QNX_STATE_INITIAL;
+   
+   // the descriptor may be compact, see QNX_PULSE_MSGSEND_SIZE
+}
+
+
+// ---------------------------------------------------------------------
+
+
+int qnx_internal_msgsend_cache_init(void)
+{
+   msgsend_cache = kmem_cache_create("qnx_internal_msgsend", sizeof(struct qnx_internal_msgsend), 
+                                     0, SLAB_HWCACHE_ALIGN, 0);
+   if (unlikely(!msgsend_cache))
+      return -ENOMEM;
+      
+   pulse_cache = kmem_cache_create("qnx_pulse", QNX_PULSE_MSGSEND_SIZE, 0, SLAB_HWCACHE_ALIGN, 0);
+   if (unlikely(!pulse_cache))
+   {
+      kmem_cache_destroy(msgsend_cache);
+      return -ENOMEM;
+   }
+   
+   return 0;
+}
+
+
+void qnx_internal_msgsend_cache_destroy(void)
+{
+   kmem_cache_destroy(pulse_cache);
+   kmem_cache_destroy(msgsend_cache);
+}
+
+
+unsigned long qnx_internal_msgsend_get_allocations(void)
+{
+   unsigned long rc = 0;
+   int cpu;
+   
+   for_each_possible_cpu(cpu)
+   {
+      rc += per_cpu(qnx_msgsend_allocations, cpu);
+   }
+   
+   return rc;
+}
+
+
+struct qnx_internal_msgsend* qnx_internal_msgsend_alloc(void)
+{
+   struct qnx_internal_msgsend* data;
+   
+   this_cpu_inc(qnx_msgsend_allocations);
+   
+   data = (struct qnx_internal_msgsend*)kmem_cache_alloc(msgsend_cache, GFP_USER);
+   if (likely(data))
+   {
+      data->pool = 0;
+      data->pulse_pool = 0;
+      data->kbuf = 0;
+   }
+      
+   return data;
+}
+
+
+struct qnx_internal_msgsend* qnx_internal_msgsend_alloc_pulse(void)
+{
+   this_cpu_inc(qnx_msgsend_allocations);
+   
+   return (struct qnx_internal_msgsend*)kmem_cache_alloc(pulse_cache, GFP_USER);
+}
+
+
+void qnx_internal_msgsend_free_pulse(struct qnx_internal_msgsend* data)
+{
+   kmem_cache_free(pulse_cache, data);
+}
+
+
+int qnx_internal_msgsend_alloc_bulk(struct qnx_internal_msgsend** data, int num)
+{
+   int i;
+   
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0)
+   if (unlikely(!kmem_cache_alloc_bulk(msgsend_cache, GFP_USER, num, (void**)data)))
+      return -ENOMEM;
+#else
+   for (i=0; i<num; ++i)
+   {
+      data[i] = (struct qnx_internal_msgsend*)kmem_cache_alloc(msgsend_cache, GFP_USER);
+      if (unlikely(!data[i]))
+      {
+         while (--i >= 0)
+            kmem_cache_free(msgsend_cache, data[i]);
+            
+         return -ENOMEM;
+      }
+   }
+#endif
+
+   this_cpu_add(qnx_msgsend_allocations, num);
+   
+   for (i=0; i<num; ++i)
+   {
+      data[i]->pool = 0;
+      data[i]->pulse_pool = 0;
+      data[i]->kbuf = 0;
+   }
+   
+   return 0;
+}
+
+
+void qnx_internal_msgsend_free(struct qnx_internal_msgsend* data)
+{
+   // compact, so don't touch the payload
+   if (data->pulse_pool)
+   {
+      qnx_pulse_pool_put(data->pulse_pool, data);
+      return;
+   }
+   
+   free_payload(data);
+   
+   if (data->pool)
+   {
+      qnx_msgsend_pool_put(data->pool, data);
+   }
+   else
+      kmem_cache_free(msgsend_cache, data);
+}
+
+
 int qnx_internal_msgsend_initv(struct qnx_internal_msgsend* data, struct qnx_io_msgsendv* _iov, pid_t pid)
 {   
    int rc = -ENOMEM;
@@ -26,106 +283,121 @@ int qnx_internal_msgsend_initv(struct qnx_internal_msgsend* data, struct qnx_io_
    size_t outlen = iov_length(_iov->out, _iov->out_len);
    
    void* inbuf = 0;
-   void* outbuf = 0;
    
-   inbuf = kmalloc(inlen, GFP_USER);   
-   if (unlikely(!inbuf))
-      goto out;
+   data->pool = 0;
    
-   if (outlen > 0)
+   if (!use_direct_copy(inlen))
    {
-      outbuf = kmalloc(outlen, GFP_USER);   
-      if (unlikely(!outbuf))
-         goto out_free_inbuf;
+      inbuf = alloc_payload(data, inlen);   
+      if (unlikely(!inbuf))
+         goto out;
    }
    
    data->task = current; 
+   data->boost = 0;
+   init_waitqueue_head(&data->reply_queue);
             
-   if (unlikely(memcpy_fromiovec(inbuf, _iov->in, inlen)))
-      goto out_free_all;
+   if (inbuf)
+   {
+      struct qnx_iov_iter iter;
+      qnx_iov_iter_init(&iter, _iov->in, _iov->in_len, 0);
+      
+      if (unlikely(qnx_iov_iter_copy_from_user(inbuf, &iter, inlen)))
+      {
+         rc = -EFAULT;
+         goto out_free_inbuf;
+      }
+   }
       
    data->rcvid = get_new_rcvid();   
    data->status = 0;   
    data->sender_pid = pid;
    data->receiver_pid = 0;
+   data->priority = current_priority();
    
    data->data.msg.coid = _iov->coid;      
-   data->data.msg.timeout_ms = _iov->timeout_ms;
+   data->data.msg.timeout = _iov->timeout;
    
-   data->data.msg.in.iov_base = inbuf;
+   data->data.msg.in.iov_base = 0;
    data->data.msg.in.iov_len = inlen;
    
-   data->data.msg.out.iov_base = outbuf;
+   data->data.msg.out.iov_base = 0;
    data->data.msg.out.iov_len = outlen;
    
-   memset(&data->reply, 0, sizeof(data->reply));
+   data->kbuf = inbuf;
+   data->siov = inbuf ? 0 : _iov->in;
+   data->sparts = inbuf ? 0 : _iov->in_len;
+   
+   // MsgReply writes directly into the sender's iovec
+   data->riov = _iov->out;
+   data->rparts = _iov->out_len;
+   
+   atomic_set(&data->readers, 0);
    
    data->state = QNX_STATE_INITIAL;
    
    rc = 0;
    goto out;
 
-out_free_all:
-   kfree(outbuf);
-   rc = -EFAULT;
-
 out_free_inbuf:
-   kfree(inbuf);
+   data->kbuf = inbuf;
+   free_payload(data);
    
 out:
    return rc;
 }
 
 
-int qnx_internal_msgsend_init_noreplyv(struct qnx_internal_msgsend** _data, struct qnx_io_msgsendv* _iov, pid_t pid)
+int qnx_internal_msgsend_init_noreplyv(struct qnx_internal_msgsend* data, struct qnx_io_msgsendv* _iov, pid_t pid)
 {   
-   int rc;   
-   struct qnx_internal_msgsend* data;
-   void* inbuf = 0;   
+   void* inbuf;   
    
    size_t inlen = iov_length(_iov->in, _iov->in_len);      
    
-   if (unlikely(inlen > qnx_max_noreply_msg_size))         
+   data->kbuf = 0;
+   
+   if (unlikely(inlen > noreply_max_size(data)))         
       return -EINVAL;      
       
-   data = (struct qnx_internal_msgsend*)kmalloc(sizeof(struct qnx_internal_msgsend) + inlen, GFP_USER);
-   if (unlikely(!data))
+   inbuf = alloc_payload(data, inlen);
+   if (unlikely(!inbuf))
       return -ENOMEM;
-         
-   inbuf = data + 1;
    
+   data->kbuf = inbuf;
    data->task = 0;   // no reply 
-   *_data = data;
             
-   if (unlikely(memcpy_fromiovec(inbuf, _iov->in, inlen)))
-      goto out_free;
+   {
+      struct qnx_iov_iter iter;
+      qnx_iov_iter_init(&iter, _iov->in, _iov->in_len, 0);
+      
+      if (unlikely(qnx_iov_iter_copy_from_user(inbuf, &iter, inlen)))
+         return -EFAULT;
+   }
       
    data->rcvid = get_new_rcvid();   
    data->status = 0;   
    data->sender_pid = pid;
    data->receiver_pid = 0;
+   data->priority = current_priority();
    
    data->data.msg.coid = _iov->coid;      
-   data->data.msg.timeout_ms = _iov->timeout_ms;
+   data->data.msg.timeout = _iov->timeout;
    
-   data->data.msg.in.iov_base = inbuf;
+   data->data.msg.in.iov_base = 0;
    data->data.msg.in.iov_len = inlen;
    
    data->data.msg.out.iov_base = 0;
    data->data.msg.out.iov_len = 0;
    
-   memset(&data->reply, 0, sizeof(data->reply));
+   data->siov = 0;
+   data->sparts = 0;
+   data->riov = 0;
+   data->rparts = 0;
+   atomic_set(&data->readers, 0);
    
    data->state = QNX_STATE_INITIAL;
    
-   rc = 0;
-   goto out;
-
-out_free:
-   kfree(data);
-   
-out:
-   return rc;
+   return 0;
 }
 
 
@@ -138,99 +410,176 @@ int qnx_internal_msgsend_init(struct qnx_internal_msgsend* data, struct qnx_io_m
    if (unlikely(copy_from_user(&data->data.msg, io, sizeof(struct qnx_io_msgsend))))
       return -EFAULT;
       
-   buf = kmalloc(data->data.msg.in.iov_len, GFP_USER);
-   if (unlikely(!buf))
-      return -ENOMEM;
-         
-   if (unlikely(copy_from_user(buf, data->data.msg.in.iov_base, data->data.msg.in.iov_len)))
+   if (use_direct_copy(data->data.msg.in.iov_len))
    {
-      kfree(buf);
-      return -EFAULT;
+      // the receiver copies straight out of our buffer while we are blocked
+      data->siov = &data->data.msg.in;
+      data->sparts = 1;
+   }
+   else
+   {
+      buf = alloc_payload(data, data->data.msg.in.iov_len);
+      if (unlikely(!buf))
+         return -ENOMEM;
+            
+      data->kbuf = buf;
+      
+      if (unlikely(copy_from_user(buf, data->data.msg.in.iov_base, data->data.msg.in.iov_len)))
+      {
+         free_payload(data);
+         return -EFAULT;
+      }
    }
    
+   // MsgReply writes directly into our buffer
+   data->riov = &data->data.msg.out;
+   data->rparts = 1;
+   
    data->rcvid = get_new_rcvid();   
    data->sender_pid = pid;
+   data->priority = current_priority();
    data->task = current;   
+   init_waitqueue_head(&data->reply_queue);
    data->state = QNX_STATE_INITIAL;
-   data->data.msg.in.iov_base = buf;
+   atomic_set(&data->readers, 0);
    
    return 0;
 }
 
 
-int qnx_internal_msgsend_init_noreply(struct qnx_internal_msgsend** out_data, struct qnx_io_msgsend* io, pid_t pid)
+int qnx_internal_msgsend_init_noreply(struct qnx_internal_msgsend* data, struct qnx_io_msgsend* io, pid_t pid)
 {
-   struct qnx_internal_msgsend* data;
    struct qnx_io_msgsend tmp;
-   void* buf;
+   
+   data->kbuf = 0;
    
    if (unlikely(copy_from_user(&tmp, io, sizeof(struct qnx_io_msgsend))))
       return -EFAULT;
       
-   data = (struct qnx_internal_msgsend*)kmalloc(sizeof(struct qnx_internal_msgsend) + tmp.in.iov_len, GFP_USER);
-   if (unlikely(!data))
-      return -ENOMEM;
+   return init_noreply(data, tmp.coid, tmp.in.iov_base, tmp.in.iov_len, pid);
+}
 
-   memset(data, 0, sizeof(struct qnx_internal_msgsend));
-   memcpy(&data->data, &tmp, sizeof(tmp));
-   buf = data + 1;
-   
-   if (unlikely(copy_from_user(buf, data->data.msg.in.iov_base, data->data.msg.in.iov_len)))
-   {
-      kfree(data);
-      return -EFAULT;
-   }
-   
-   data->rcvid = get_new_rcvid();   
-   data->sender_pid = pid;
-   data->state = QNX_STATE_INITIAL;
-   data->data.msg.in.iov_base = buf;
-   // data->task will stay zero here!
 
-   *out_data = data;
+int qnx_internal_msgsend_init_noreply_batch(struct qnx_internal_msgsend* data, const struct _noreply_batch* msg, pid_t pid)
+{
+   data->kbuf = 0;
    
-   return 0;
+   if (unlikely(msg->sbytes < 0))
+      return -EINVAL;
+      
+   return init_noreply(data, msg->coid, msg->smsg, msg->sbytes, pid);
 }
 
 
-int qnx_internal_msgsend_init_pulse(struct qnx_internal_msgsend* data, struct qnx_io_msgsendpulse* io, pid_t pid)
+void qnx_internal_msgsend_init_pulse(struct qnx_internal_msgsend* data, const struct qnx_io_msgsendpulse* io, pid_t pid)
 {
-   if (unlikely(copy_from_user(&data->data, io, sizeof(struct qnx_io_msgsendpulse))))
-      return -EFAULT;
+   init_pulse(data, io->coid, io->priority, io->code, io->value, pid);
+}
 
-   data->rcvid = 0;     // is a pulse
+
+void qnx_internal_msgsend_init_pulse_batch(struct qnx_internal_msgsend* data, const struct _pulse_batch* pulse, pid_t pid)
+{
+   init_pulse(data, pulse->coid, pulse->priority, pulse->code, pulse->value, pid);
+}
+
+
+void qnx_internal_msgsend_init_ring(struct qnx_internal_msgsend* data, struct qnx_submit_ring* ring)
+{
+   const struct qnx_ring_slot* slot = qnx_submit_ring_front(ring);
+   
+   // the slot is shared with the sender, read every field only once
+   int type = ACCESS_ONCE(slot->type);
+   int len = ACCESS_ONCE(slot->len);
+   int priority = ACCESS_ONCE(slot->priority);
+   
    data->status = 0;
-   data->sender_pid = pid;
+   data->priority = clamp(priority, 0, QNX_NUM_PRIORITIES - 1);
+   data->sender_pid = ring->sender_pid;
    data->receiver_pid = 0;
-   data->task = 0;      // pulses don't have replies
+   data->task = 0;   // no reply in any case
    data->state = QNX_STATE_INITIAL;
-
-   memset(&data->reply, 0, sizeof(data->reply));
    
-   return 0;
+   data->kbuf = 0;
+   data->siov = 0;
+   data->sparts = 0;
+   data->riov = 0;
+   data->rparts = 0;
+   atomic_set(&data->readers, 0);
+   
+   if (type == QNX_RING_PULSE)
+   {
+      data->rcvid = 0;
+      
+      data->data.pulse.coid = ring->coid;
+      data->data.pulse.code = ACCESS_ONCE(slot->code);
+      data->data.pulse.value = ACCESS_ONCE(slot->value);
+   }
+   else
+   {
+      len = clamp(len, 0, QNX_SMALL_MSG_SIZE);
+      memcpy(data->inline_buf, slot->data, len);
+      
+      data->rcvid = get_new_rcvid();
+      
+      data->data.msg.coid = ring->coid;
+      data->data.msg.timeout.flags = 0;
+      
+      data->data.msg.in.iov_base = 0;
+      data->data.msg.in.iov_len = len;
+      
+      data->data.msg.out.iov_base = 0;
+      data->data.msg.out.iov_len = 0;
+      
+      data->kbuf = data->inline_buf;
+   }
+   
+   qnx_submit_ring_pop(ring);
 }
 
 
-void qnx_internal_msgsend_destroy(struct qnx_internal_msgsend* data)
-{      
-   // only free if not directly attached data
-   if (data->task)
+ssize_t qnx_internal_msgsend_read(struct qnx_internal_msgsend* data, size_t offset, struct qnx_iov_iter* dst, size_t len)
+{
+   if (unlikely(offset > data->data.msg.in.iov_len))
+      return -EINVAL;
+      
+   len = min(len, data->data.msg.in.iov_len - offset);
+   
+   if (data->kbuf)
    {
-      kfree(data->data.msg.in.iov_base);
-      kfree(data->reply.iov_base);
+      if (unlikely(qnx_iov_iter_copy_to_user(dst, data->kbuf + offset, len)))
+         return -EFAULT;
+         
+      return len;
+   }
+   else
+   {
+      struct qnx_iov_iter src;
+      qnx_iov_iter_init(&src, data->siov, data->sparts, offset);
+      
+      return qnx_remote_copy_from(data->task, &src, dst, len);
    }
 }
 
 
-void qnx_internal_msgsend_destroyv(struct qnx_internal_msgsend* data)
-{      
-   if (data->task != 0)
-   {
-      kfree(data->data.msg.in.iov_base);
-      kfree(data->data.msg.out.iov_base);
+ssize_t qnx_internal_msgsend_write_reply(struct qnx_internal_msgsend* data, struct qnx_iov_iter* src, size_t len)
+{
+   struct qnx_iov_iter dst;
    
-      kfree(data->reply.iov_base);
-   }
+   len = min(len, data->data.msg.out.iov_len);
+   if (len == 0)
+      return 0;
+   
+   qnx_iov_iter_init(&dst, data->riov, data->rparts, 0);
+   
+   return qnx_remote_copy_to(data->task, &dst, src, len);
+}
+
+
+void qnx_internal_msgsend_destroy(struct qnx_internal_msgsend* data)
+{      
+   // only free if not directly attached data
+   if (data->task)
+      free_payload(data);
 }
 
 
@@ -240,12 +589,68 @@ void qnx_internal_msgsend_cleanup_and_free(struct qnx_internal_msgsend* send_dat
    if (send_data->task == 0)
    {            
       // pulse or no-reply message...
-      kfree(send_data);
+      qnx_internal_msgsend_free(send_data);
    }
    else
    {      
       // normal message
-      send_data->status = -ESRCH;
-      wake_up_process(send_data->task);
+      qnx_internal_msgsend_finish(send_data, -ESRCH, 0);
    }       
 }
+
+
+void qnx_internal_msgsend_cleanup_and_free_all(struct list_head* msgs)
+{
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+   
+   // the sender may be gone as soon as it is finished, so unlink first
+   list_for_each_entry_safe(data, next, msgs, hook)
+   {
+      list_del(&data->hook);
+      qnx_internal_msgsend_cleanup_and_free(data);
+   }
+}
+
+
+void qnx_internal_msgsend_finish(struct qnx_internal_msgsend* data, int status, int sync)
+{
+   // the sender must not return before the wakeup is done, it waits for the readers
+   atomic_inc(&data->readers);
+   
+   data->status = status;
+   
+   // full barrier, the status is visible before the state
+   if (unlikely(xchg(&data->state, QNX_STATE_FINISHED) == QNX_STATE_CANCELLING))
+      wake_up(&data->reply_queue);   // sleeps uninterruptibly
+   else if (sync)
+      wake_up_interruptible_sync(&data->reply_queue);
+   else
+      wake_up_interruptible(&data->reply_queue);
+   
+   qnx_internal_msgsend_put_reader(data);
+}
+
+
+void qnx_internal_msgsend_put_reader(struct qnx_internal_msgsend* data)
+{
+   unsigned long flags;
+   
+   // under the queue's lock, the sender syncs with it before its stack goes away
+   spin_lock_irqsave(&data->reply_queue.lock, flags);
+   
+   if (atomic_dec_and_test(&data->readers))
+      wake_up_locked(&data->reply_queue);
+      
+   spin_unlock_irqrestore(&data->reply_queue.lock, flags);
+}
+
+
+void qnx_internal_msgsend_wait_readers(struct qnx_internal_msgsend* data)
+{
+   wait_event(data->reply_queue, atomic_read(&data->readers) == 0);
+   
+   // the last reader may still be inside qnx_internal_msgsend_put_reader
+   spin_lock_irq(&data->reply_queue.lock);
+   spin_unlock_irq(&data->reply_queue.lock);
+}
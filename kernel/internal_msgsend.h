@@ -2,63 +2,175 @@
 #define __QNX_INTERNAL_MSGSEND_H
 
 
+/**
+ * Request states, a blocking request goes
+ * 
+ *   INITIAL (queued) -> RECEIVING -> PENDING -> FINISHED
+ * 
+ * A cancelling sender (timeout or signal) moves RECEIVING or PENDING to 
+ * CANCELLING and sleeps until the receiver resp. the replier moves on, 
+ * which wakes it up.
+ */
 #define QNX_STATE_INITIAL     0
 #define QNX_STATE_RECEIVING   1
 #define QNX_STATE_PENDING     2
 #define QNX_STATE_FINISHED    3
+#define QNX_STATE_CANCELLING  4
 
 
 #include <linux/types.h>
 #include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/llist.h>
 
 #include "qnxcomm_driver.h"
 
 
+/// payloads up to this size are stored within the message
+#define QNX_INLINE_MSG_SIZE   QNX_SMALL_MSG_SIZE
+
+
+// forward decls
+struct qnx_iov_iter;
+struct qnx_msgsend_pool;
+struct qnx_pulse_pool;
+struct qnx_submit_ring;
+struct qnx_prio_boost;
+
+
 struct qnx_internal_msgsend
 {
    struct list_head hook;
+   struct llist_node node;      ///< hook for the channel's lock-free incoming list
    
    int rcvid;                   ///< 0 for pulse, else > 0
    int status;
+   int priority;                ///< the sender's realtime priority or the pulse priority, see struct qnx_msg_queue
+   u32 seq;                     ///< order of the channel's queues, see qnx_channel_first_message
    
    pid_t sender_pid;
    pid_t receiver_pid;
    int receiver_chid;
    
+   int state;
+   struct task_struct* task;   ///< 0 for pulse or noreply message
+   
+   struct qnx_msgsend_pool* pool;         ///< owning pool, 0 if allocated from the heap or on the stack
+   struct qnx_pulse_pool* pulse_pool;     ///< owning pool of a compact pulse, see QNX_PULSE_MSGSEND_SIZE
+   
    union
    {
       struct qnx_io_msgsend msg;
       struct qnx_io_msgsendpulse pulse; 
    } data;
-      
-   struct iovec reply;
-   struct task_struct* task;   ///< 0 for pulse or noreply message
    
-   int state;
+   // pulses never touch the members below
+   
+   wait_queue_head_t reply_queue;   ///< the sender waits here for QNX_STATE_FINISHED
+   
+   void* kbuf;                 ///< payload copied to the kernel, 0 if copied directly from the sender
+   const struct iovec* siov;   ///< payload within the sender's address space (direct copy only)
+   int sparts;
+   
+   const struct iovec* riov;   ///< reply buffer within the sender's address space
+   int rparts;
+   
+   atomic_t readers;           ///< MsgRead calls currently accessing the sender's payload
+   
+   int wake_on_pending;        ///< the sender's deadline only covers the reply blocked state
+   
+   struct qnx_prio_boost* boost;   ///< set while the request boosts the receiving thread
+   
+   char inline_buf[QNX_INLINE_MSG_SIZE];   ///< kbuf points here for small messages
 };
 
 
+/// pulses from a struct qnx_pulse_pool are only allocated up to the pulse data
+#define QNX_PULSE_MSGSEND_SIZE \
+   (offsetof(struct qnx_internal_msgsend, data) + sizeof(struct qnx_io_msgsendpulse))
+
+
 // ---------------------------------------------------------------------
 
 
+/// descriptor cache, setup during module init
+int qnx_internal_msgsend_cache_init(void);
+
+void qnx_internal_msgsend_cache_destroy(void);
+
+unsigned long qnx_internal_msgsend_get_allocations(void);
+
+
+/// heap allocated descriptors (pulses and noreply messages), pooled descriptors are returned to their pool
+struct qnx_internal_msgsend* qnx_internal_msgsend_alloc(void);
+
+/// compact pulse descriptors (QNX_PULSE_MSGSEND_SIZE), only used by struct qnx_pulse_pool
+struct qnx_internal_msgsend* qnx_internal_msgsend_alloc_pulse(void);
+
+void qnx_internal_msgsend_free_pulse(struct qnx_internal_msgsend* data);
+
+/// all or nothing, the descriptors can be given back one by one with qnx_internal_msgsend_free
+int qnx_internal_msgsend_alloc_bulk(struct qnx_internal_msgsend** data, int num);
+
+void qnx_internal_msgsend_free(struct qnx_internal_msgsend* data);
+
+
 /// constructors
 int qnx_internal_msgsend_init(struct qnx_internal_msgsend* data, struct qnx_io_msgsend* io, pid_t pid);
 
-int qnx_internal_msgsend_init_noreply(struct qnx_internal_msgsend** out_data, struct qnx_io_msgsend* io, pid_t pid);
+int qnx_internal_msgsend_init_noreply(struct qnx_internal_msgsend* data, struct qnx_io_msgsend* io, pid_t pid);
 
 int qnx_internal_msgsend_initv(struct qnx_internal_msgsend* data, struct qnx_io_msgsendv* _iov, pid_t pid);
 
-int qnx_internal_msgsend_init_noreplyv(struct qnx_internal_msgsend** data, struct qnx_io_msgsendv* _iov, pid_t pid);
+int qnx_internal_msgsend_init_noreplyv(struct qnx_internal_msgsend* data, struct qnx_io_msgsendv* _iov, pid_t pid);
+
+/// io is already copied to the kernel
+void qnx_internal_msgsend_init_pulse(struct qnx_internal_msgsend* data, const struct qnx_io_msgsendpulse* io, pid_t pid);
+
+/// batch entries are already copied to the kernel, the noreply payload is not
+int qnx_internal_msgsend_init_noreply_batch(struct qnx_internal_msgsend* data, const struct _noreply_batch* msg, pid_t pid);
 
-int qnx_internal_msgsend_init_pulse(struct qnx_internal_msgsend* data, struct qnx_io_msgsendpulse* io, pid_t pid);
+void qnx_internal_msgsend_init_pulse_batch(struct qnx_internal_msgsend* data, const struct _pulse_batch* pulse, pid_t pid);
+
+/// takes the next pulse or noreply message out of the ring, the channel's waiting_lock must be held
+void qnx_internal_msgsend_init_ring(struct qnx_internal_msgsend* data, struct qnx_submit_ring* ring);
+
+
+/// the sender's connection
+static inline
+int qnx_internal_msgsend_coid(const struct qnx_internal_msgsend* data)
+{
+   return data->rcvid == 0 ? data->data.pulse.coid : data->data.msg.coid;
+}
+
+
+/// payload access
+ssize_t qnx_internal_msgsend_read(struct qnx_internal_msgsend* data, size_t offset, struct qnx_iov_iter* dst, size_t len);
+
+ssize_t qnx_internal_msgsend_write_reply(struct qnx_internal_msgsend* data, struct qnx_iov_iter* src, size_t len);
 
 
 /// destructors
 void qnx_internal_msgsend_cleanup_and_free(struct qnx_internal_msgsend* send_data);
 
+/// fails all messages on the list (linked by hook) in one pass, no locks may be held
+void qnx_internal_msgsend_cleanup_and_free_all(struct list_head* msgs);
+
 void qnx_internal_msgsend_destroy(struct qnx_internal_msgsend* send_data);
 
-void qnx_internal_msgsend_destroyv(struct qnx_internal_msgsend* data);
+
+/**
+ * Wakes up the blocked sender with the given status. Set @c sync if the 
+ * caller is going to block, so the sender may take over this cpu.
+ */
+void qnx_internal_msgsend_finish(struct qnx_internal_msgsend* data, int status, int sync);
+
+
+/// drops a readers count taken by qnx_pending_table_get_reader, the last one wakes up the sender
+void qnx_internal_msgsend_put_reader(struct qnx_internal_msgsend* data);
+
+/// called by the sender before its buffers go away, sleeps until no MsgRead copies from them anymore
+void qnx_internal_msgsend_wait_readers(struct qnx_internal_msgsend* data);
 
 
 #endif   // __QNX_INTERNAL_MSGSEND_H
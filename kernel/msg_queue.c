@@ -0,0 +1,90 @@
+#include "msg_queue.h"
+#include "internal_msgsend.h"
+
+
+/// the highest priority gets bit 0
+#define QNX_PRIO_BIT(prio) (QNX_NUM_PRIORITIES - 1 - (prio))
+
+
+void qnx_msg_queue_init(struct qnx_msg_queue* queue)
+{
+   int i;
+   
+   bitmap_zero(queue->used, QNX_NUM_PRIORITIES);
+   
+   for (i=0; i<QNX_NUM_PRIORITIES; ++i)
+      INIT_LIST_HEAD(&queue->lists[i]);
+}
+
+
+void qnx_msg_queue_add(struct qnx_msg_queue* queue, struct qnx_internal_msgsend* data)
+{
+   int bit = QNX_PRIO_BIT(data->priority);
+   
+   list_add_tail(&data->hook, &queue->lists[bit]);
+   __set_bit(bit, queue->used);
+}
+
+
+void qnx_msg_queue_remove(struct qnx_msg_queue* queue, struct qnx_internal_msgsend* data)
+{
+   int bit = QNX_PRIO_BIT(data->priority);
+   
+   list_del(&data->hook);
+   
+   if (list_empty(&queue->lists[bit]))
+      __clear_bit(bit, queue->used);
+}
+
+
+struct qnx_internal_msgsend* qnx_msg_queue_first(struct qnx_msg_queue* queue)
+{
+   int bit = find_first_bit(queue->used, QNX_NUM_PRIORITIES);
+   
+   if (bit >= QNX_NUM_PRIORITIES)
+      return 0;
+      
+   return list_first_entry(&queue->lists[bit], struct qnx_internal_msgsend, hook);
+}
+
+
+void qnx_msg_queue_splice(struct qnx_msg_queue* queue, struct list_head* list)
+{
+   int bit;
+   
+   for_each_set_bit(bit, queue->used, QNX_NUM_PRIORITIES)
+      list_splice_tail_init(&queue->lists[bit], list);
+   
+   bitmap_zero(queue->used, QNX_NUM_PRIORITIES);
+}
+
+
+void qnx_msg_queue_for_each(struct qnx_msg_queue* queue, mq_callback_t func, void* arg)
+{
+   struct qnx_internal_msgsend* data;
+   int bit;
+   
+   for_each_set_bit(bit, queue->used, QNX_NUM_PRIORITIES)
+   {
+      list_for_each_entry(data, &queue->lists[bit], hook)
+         func(data, arg);
+   }
+}
+
+
+struct qnx_internal_msgsend* qnx_msg_queue_find(struct qnx_msg_queue* queue, int priority, mq_match_t match, const void* arg)
+{
+   struct qnx_internal_msgsend* data;
+   int bit = QNX_PRIO_BIT(priority);
+   
+   if (!test_bit(bit, queue->used))
+      return 0;
+   
+   list_for_each_entry_reverse(data, &queue->lists[bit], hook)
+   {
+      if (match(data, arg))
+         return data;
+   }
+   
+   return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef __QNXCOMM_MSG_QUEUE_H
+#define __QNXCOMM_MSG_QUEUE_H
+
+
+#include <linux/list.h>
+#include <linux/bitops.h>
+
+
+/// priorities 0 (lowest) ... QNX_NUM_PRIORITIES - 1, as linux realtime priorities
+#define QNX_NUM_PRIORITIES   100
+
+
+// forward decl
+struct qnx_internal_msgsend;
+
+
+typedef void(*mq_callback_t)(struct qnx_internal_msgsend*, void*);
+
+typedef int(*mq_match_t)(const struct qnx_internal_msgsend*, const void*);
+
+
+/**
+ * The messages waiting on a channel, one FIFO list per priority. A bit 
+ * is set for each non-empty list, the highest priority maps to bit 0, so 
+ * the next message to receive is found with a single find_first_bit.
+ * Not synchronized, the channel's waiting_lock protects the queue.
+ */
+struct qnx_msg_queue
+{
+   DECLARE_BITMAP(used, QNX_NUM_PRIORITIES);
+   
+   struct list_head lists[QNX_NUM_PRIORITIES];
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// constructor
+void qnx_msg_queue_init(struct qnx_msg_queue* queue);
+
+
+static inline
+int qnx_msg_queue_empty(const struct qnx_msg_queue* queue)
+{
+   return bitmap_empty(queue->used, QNX_NUM_PRIORITIES);
+}
+
+
+/// appends the message to the list of its priority
+void qnx_msg_queue_add(struct qnx_msg_queue* queue, struct qnx_internal_msgsend* data);
+
+void qnx_msg_queue_remove(struct qnx_msg_queue* queue, struct qnx_internal_msgsend* data);
+
+/// the oldest message of the highest priority, 0 if empty. The message stays queued.
+struct qnx_internal_msgsend* qnx_msg_queue_first(struct qnx_msg_queue* queue);
+
+/// empties the queue, the messages are appended to @c list in the order they would be received
+void qnx_msg_queue_splice(struct qnx_msg_queue* queue, struct list_head* list);
+
+/// calls func for each message in receive order
+void qnx_msg_queue_for_each(struct qnx_msg_queue* queue, mq_callback_t func, void* arg);
+
+/// the newest message of the given priority for which match returns non-zero, 0 if there is none
+struct qnx_internal_msgsend* qnx_msg_queue_find(struct qnx_msg_queue* queue, int priority, mq_match_t match, const void* arg);
+
+
+#endif   // __QNXCOMM_MSG_QUEUE_H
@@ -0,0 +1,83 @@
+#include "msgsend_pool.h"
+#include "internal_msgsend.h"
+
+#include <linux/vmalloc.h>
+
+
+int qnx_msgsend_pool_init(struct qnx_msgsend_pool* pool, unsigned int num_slots, size_t slot_size)
+{
+   unsigned int i;
+
+   INIT_LIST_HEAD(&pool->free);
+   spin_lock_init(&pool->lock);
+
+   pool->num_slots = num_slots;
+   pool->slot_size = slot_size;
+   pool->payload = 0;
+
+   // this may be a large area, vmalloc is sufficient since it's never used for DMA
+   pool->slots = (struct qnx_internal_msgsend*)vzalloc(num_slots * sizeof(struct qnx_internal_msgsend));
+   if (unlikely(!pool->slots))
+      return -ENOMEM;
+
+   // small payloads fit into the descriptor itself
+   if (slot_size > QNX_INLINE_MSG_SIZE)
+   {
+      pool->payload = (char*)vmalloc(num_slots * slot_size);
+      if (unlikely(!pool->payload))
+      {
+         vfree(pool->slots);
+         return -ENOMEM;
+      }
+   }
+
+   for (i=0; i<num_slots; ++i)
+   {
+      pool->slots[i].pool = pool;
+      list_add_tail(&pool->slots[i].hook, &pool->free);
+   }
+
+   return 0;
+}
+
+
+void qnx_msgsend_pool_destroy(struct qnx_msgsend_pool* pool)
+{
+   vfree(pool->payload);
+   vfree(pool->slots);
+}
+
+
+struct qnx_internal_msgsend* qnx_msgsend_pool_get(struct qnx_msgsend_pool* pool)
+{
+   struct qnx_internal_msgsend* data = 0;
+
+   spin_lock(&pool->lock);
+
+   if (likely(!list_empty(&pool->free)))
+   {
+      data = list_first_entry(&pool->free, struct qnx_internal_msgsend, hook);
+      list_del(&data->hook);
+   }
+
+   spin_unlock(&pool->lock);
+
+   return data;
+}
+
+
+void qnx_msgsend_pool_put(struct qnx_msgsend_pool* pool, struct qnx_internal_msgsend* data)
+{
+   spin_lock(&pool->lock);
+   list_add(&data->hook, &pool->free);   // LIFO, the last used slot is still cache hot
+   spin_unlock(&pool->lock);
+}
+
+
+void* qnx_msgsend_pool_payload(struct qnx_msgsend_pool* pool, struct qnx_internal_msgsend* data)
+{
+   if (unlikely(!pool->payload))
+      return 0;
+
+   return pool->payload + (data - pool->slots) * pool->slot_size;
+}
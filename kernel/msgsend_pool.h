@@ -0,0 +1,48 @@
+#ifndef __QNXCOMM_MSGSEND_POOL_H
+#define __QNXCOMM_MSGSEND_POOL_H
+
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+
+
+// forward decls
+struct qnx_internal_msgsend;
+
+
+/**
+ * Fixed number of preallocated message descriptors, each with a payload 
+ * slot of fixed size. Used for noreply messages so enqueueing them does 
+ * not allocate any memory.
+ */
+struct qnx_msgsend_pool
+{
+   struct list_head free;
+   spinlock_t lock;
+   
+   unsigned int num_slots;
+   size_t slot_size;             ///< payload bytes per descriptor
+   
+   struct qnx_internal_msgsend* slots;
+   char* payload;
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// construction/destruction
+int qnx_msgsend_pool_init(struct qnx_msgsend_pool* pool, unsigned int num_slots, size_t slot_size);
+
+void qnx_msgsend_pool_destroy(struct qnx_msgsend_pool* pool);
+
+
+/// slot management, get returns 0 if all slots are in use
+struct qnx_internal_msgsend* qnx_msgsend_pool_get(struct qnx_msgsend_pool* pool);
+
+void qnx_msgsend_pool_put(struct qnx_msgsend_pool* pool, struct qnx_internal_msgsend* data);
+
+void* qnx_msgsend_pool_payload(struct qnx_msgsend_pool* pool, struct qnx_internal_msgsend* data);
+
+
+#endif   // __QNXCOMM_MSGSEND_POOL_H
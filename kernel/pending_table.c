@@ -0,0 +1,146 @@
+#include "pending_table.h"
+#include "internal_msgsend.h"
+
+
+static inline
+struct qnx_pending_bucket* get_bucket(struct qnx_pending_table* table, int rcvid)
+{
+   return &table->buckets[rcvid & (QNX_PENDING_BUCKETS - 1)];
+}
+
+
+static inline
+int get_slot(int rcvid)
+{
+   return rcvid / QNX_PENDING_BUCKETS;
+}
+
+
+void qnx_pending_table_init(struct qnx_pending_table* table)
+{
+   int i;
+   
+   for (i=0; i<QNX_PENDING_BUCKETS; ++i)
+   {
+      idr_init(&table->buckets[i].slots);
+      spin_lock_init(&table->buckets[i].lock);
+   }
+}
+
+
+void qnx_pending_table_destroy(struct qnx_pending_table* table)
+{
+   int i;
+   
+   for (i=0; i<QNX_PENDING_BUCKETS; ++i)
+      idr_destroy(&table->buckets[i].slots);
+}
+
+
+int qnx_pending_table_add(struct qnx_pending_table* table, struct qnx_internal_msgsend* data)
+{
+   int rc;
+   struct qnx_pending_bucket* bucket = get_bucket(table, data->rcvid);
+   
+   idr_preload(GFP_KERNEL);
+   spin_lock(&bucket->lock);
+      
+   rc = idr_alloc(&bucket->slots, data, get_slot(data->rcvid), get_slot(data->rcvid) + 1, GFP_NOWAIT);
+   if (likely(rc >= 0))
+   {
+      rc = 0;
+      
+      // the sender cannot go away while the request is in the table and we hold the lock
+      if (unlikely(xchg(&data->state, QNX_STATE_PENDING) == QNX_STATE_CANCELLING || data->wake_on_pending))
+         wake_up(&data->reply_queue);
+   }
+   else
+      rc = -ENOMEM;
+   
+   spin_unlock(&bucket->lock);
+   idr_preload_end();
+   
+   return rc;
+}
+
+
+struct qnx_internal_msgsend* qnx_pending_table_remove(struct qnx_pending_table* table, int rcvid)
+{
+   struct qnx_internal_msgsend* data = 0;
+   struct qnx_pending_bucket* bucket = get_bucket(table, rcvid);
+   
+   if (unlikely(rcvid <= 0))
+      return 0;
+      
+   spin_lock(&bucket->lock);
+   
+   data = (struct qnx_internal_msgsend*)idr_find(&bucket->slots, get_slot(rcvid));
+   if (likely(data))
+      idr_remove(&bucket->slots, get_slot(rcvid));
+   
+   spin_unlock(&bucket->lock);
+   
+   return data;
+}
+
+
+struct qnx_internal_msgsend* qnx_pending_table_get_reader(struct qnx_pending_table* table, int rcvid)
+{
+   struct qnx_internal_msgsend* data;
+   struct qnx_pending_bucket* bucket = get_bucket(table, rcvid);
+   
+   if (unlikely(rcvid <= 0))
+      return 0;
+      
+   spin_lock(&bucket->lock);
+   
+   // keeps the sender from leaving while the caller copies outside the lock
+   data = (struct qnx_internal_msgsend*)idr_find(&bucket->slots, get_slot(rcvid));
+   if (likely(data))
+      atomic_inc(&data->readers);
+   
+   spin_unlock(&bucket->lock);
+   
+   return data;
+}
+
+
+void qnx_pending_table_for_each(struct qnx_pending_table* table, pt_callback_t func, void* arg)
+{
+   int i;
+   int slot;
+   struct qnx_internal_msgsend* data;
+   
+   for (i=0; i<QNX_PENDING_BUCKETS; ++i)
+   {
+      spin_lock(&table->buckets[i].lock);
+      
+      idr_for_each_entry(&table->buckets[i].slots, data, slot)
+      {
+         func(data, arg);
+      }
+      
+      spin_unlock(&table->buckets[i].lock);
+   }
+}
+
+
+void qnx_pending_table_cleanup(struct qnx_pending_table* table, struct list_head* pending)
+{
+   int i;
+   int slot;
+   struct qnx_internal_msgsend* data;
+   
+   for (i=0; i<QNX_PENDING_BUCKETS; ++i)
+   {
+      spin_lock(&table->buckets[i].lock);
+      
+      idr_for_each_entry(&table->buckets[i].slots, data, slot)
+      {
+         idr_remove(&table->buckets[i].slots, slot);
+         list_add_tail(&data->hook, pending);
+      }
+      
+      spin_unlock(&table->buckets[i].lock);
+   }
+}
@@ -0,0 +1,68 @@
+#ifndef __QNXCOMM_PENDING_TABLE_H
+#define __QNXCOMM_PENDING_TABLE_H
+
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/cache.h>
+#include <linux/idr.h>
+
+
+/// must be a power of 2
+#define QNX_PENDING_BUCKETS   32
+
+
+// forward decl
+struct qnx_internal_msgsend;
+
+
+typedef void(*pt_callback_t)(struct qnx_internal_msgsend*, void*);
+
+
+struct qnx_pending_bucket
+{
+   struct idr slots;   ///< indexed by rcvid / QNX_PENDING_BUCKETS, so the slots of a bucket are dense
+   spinlock_t lock;
+} ____cacheline_aligned_in_smp;
+
+
+/**
+ * Messages received but not yet replied, spread over the buckets by rcvid. 
+ * Since rcvids are handed out sequentially, concurrently pending requests 
+ * usually end up in different buckets, so server threads do not contend 
+ * on a single lock. Within a bucket the request is found by index, so 
+ * lookups do not depend on the number of pending requests.
+ */
+struct qnx_pending_table
+{
+   struct qnx_pending_bucket buckets[QNX_PENDING_BUCKETS];
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// construction/destruction
+void qnx_pending_table_init(struct qnx_pending_table* table);
+
+/// the table must be empty, see qnx_pending_table_cleanup
+void qnx_pending_table_destroy(struct qnx_pending_table* table);
+
+
+/// request management, -ENOMEM if there is no slot for the request
+int qnx_pending_table_add(struct qnx_pending_table* table, struct qnx_internal_msgsend* data);
+
+struct qnx_internal_msgsend* qnx_pending_table_remove(struct qnx_pending_table* table, int rcvid);
+
+/// the request stays in the table, the caller must decrement its readers count when done
+struct qnx_internal_msgsend* qnx_pending_table_get_reader(struct qnx_pending_table* table, int rcvid);
+
+
+/// the callback is called with the bucket lock held
+void qnx_pending_table_for_each(struct qnx_pending_table* table, pt_callback_t func, void* arg);
+
+/// empties the table, the requests are moved to @c pending and must be failed by the caller
+void qnx_pending_table_cleanup(struct qnx_pending_table* table, struct list_head* pending);
+
+
+#endif   // __QNXCOMM_PENDING_TABLE_H
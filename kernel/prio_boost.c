@@ -0,0 +1,141 @@
+#include "prio_boost.h"
+
+#include <linux/slab.h>
+#include <linux/sched.h>
+
+#include "compatibility.h"
+#include "internal_msgsend.h"
+#include "qnxcomm_internal.h"
+
+
+static inline
+int is_rt_policy(int policy)
+{
+   return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+
+/// deadline tasks and unknown policies are left alone
+static inline
+int is_boostable(int policy)
+{
+   return is_rt_policy(policy) || policy == SCHED_NORMAL || policy == SCHED_BATCH || policy == SCHED_IDLE;
+}
+
+
+static
+void set_scheduler(struct task_struct* task, int policy, int prio)
+{
+   struct sched_param param = { 0 };
+   param.sched_priority = prio;
+   
+   if (unlikely(sched_setscheduler_nocheck(task, policy, &param)))
+      pr_debug("changing the scheduler of tid=%d failed\n", current_get_tid_nr(task));
+}
+
+
+static
+struct qnx_prio_boost* find_boost(struct qnx_prio_boosts* boosts, struct task_struct* task)
+{
+   struct qnx_prio_boost* boost;
+   
+   list_for_each_entry(boost, &boosts->list, hook)
+   {
+      if (boost->task == task)
+         return boost;
+   }
+   
+   return 0;
+}
+
+
+void qnx_prio_boosts_init(struct qnx_prio_boosts* boosts)
+{
+   INIT_LIST_HEAD(&boosts->list);
+   mutex_init(&boosts->lock);
+}
+
+
+void qnx_prio_boosts_destroy(struct qnx_prio_boosts* boosts)
+{
+   struct qnx_prio_boost* boost;
+   struct qnx_prio_boost* next;
+   
+   // the requests still holding a boost were failed without releasing it
+   list_for_each_entry_safe(boost, next, &boosts->list, hook)
+   {
+      set_scheduler(boost->task, boost->policy, boost->prio);
+      
+      list_del(&boost->hook);
+      put_task_struct(boost->task);
+      kfree(boost);
+   }
+}
+
+
+void qnx_prio_boosts_acquire(struct qnx_prio_boosts* boosts, struct qnx_internal_msgsend* data)
+{
+   struct qnx_prio_boost* boost;
+   int policy = current->policy;
+   
+   data->boost = 0;
+   
+   // nothing to inherit
+   if (data->priority <= (is_rt_policy(policy) ? (int)current->rt_priority : 0) || !is_boostable(policy))
+      return;
+   
+   mutex_lock(&boosts->lock);
+   
+   boost = find_boost(boosts, current);
+   if (!boost)
+   {
+      boost = (struct qnx_prio_boost*)kmalloc(sizeof(struct qnx_prio_boost), GFP_KERNEL);
+      if (unlikely(!boost))
+         goto out;
+         
+      get_task_struct(current);
+      boost->task = current;
+      boost->policy = policy;
+      boost->prio = is_rt_policy(policy) ? current->rt_priority : 0;
+      boost->boosted_prio = 0;
+      boost->held = 0;
+      
+      list_add(&boost->hook, &boosts->list);
+   }
+   
+   if (data->priority > boost->boosted_prio)
+   {
+      set_scheduler(current, SCHED_FIFO, data->priority);
+      boost->boosted_prio = data->priority;
+   }
+   
+   ++boost->held;
+   data->boost = boost;
+   
+out:
+   mutex_unlock(&boosts->lock);
+}
+
+
+void qnx_prio_boosts_release(struct qnx_prio_boosts* boosts, struct qnx_internal_msgsend* data)
+{
+   struct qnx_prio_boost* boost = data->boost;
+   
+   if (likely(!boost))
+      return;
+      
+   data->boost = 0;
+   
+   mutex_lock(&boosts->lock);
+   
+   if (--boost->held == 0)
+   {
+      set_scheduler(boost->task, boost->policy, boost->prio);
+      
+      list_del(&boost->hook);
+      put_task_struct(boost->task);
+      kfree(boost);
+   }
+   
+   mutex_unlock(&boosts->lock);
+}
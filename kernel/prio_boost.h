@@ -0,0 +1,57 @@
+#ifndef __QNXCOMM_PRIO_BOOST_H
+#define __QNXCOMM_PRIO_BOOST_H
+
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+
+
+// forward decls
+struct qnx_internal_msgsend;
+struct task_struct;
+
+
+/// a receiving thread running at the priority of its clients
+struct qnx_prio_boost
+{
+   struct list_head hook;
+   
+   struct task_struct* task;   ///< holds a reference
+   
+   int policy;                 ///< restored when the last boosting request is gone
+   int prio;
+   
+   int boosted_prio;           ///< currently applied realtime priority
+   int held;                   ///< number of pending requests boosting the task
+};
+
+
+/**
+ * The boosted threads of a process (channels created with QNX_CHF_PRIO_INHERIT). 
+ * A thread keeps the highest priority it was boosted to until all boosting requests 
+ * are replied, so replying out of order never drops it below a pending client.
+ */
+struct qnx_prio_boosts
+{
+   struct list_head list;
+   struct mutex lock;   ///< changing the scheduler may sleep
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// constructor and destructor, the destructor restores all threads still boosted
+void qnx_prio_boosts_init(struct qnx_prio_boosts* boosts);
+
+void qnx_prio_boosts_destroy(struct qnx_prio_boosts* boosts);
+
+
+/// raises the calling thread to the request's priority if that is higher, the request remembers the boost
+void qnx_prio_boosts_acquire(struct qnx_prio_boosts* boosts, struct qnx_internal_msgsend* data);
+
+/// restores the boosted thread if this was its last boosting request, may be called from any thread
+void qnx_prio_boosts_release(struct qnx_prio_boosts* boosts, struct qnx_internal_msgsend* data);
+
+
+#endif   // __QNXCOMM_PRIO_BOOST_H
@@ -19,6 +19,7 @@
 #define QNX_PROC_CONNECTIONS    "connections"
 #define QNX_PROC_CHANNELS       "channels"
 #define QNX_PROC_BLOCKED_TASKS  "blocked"
+#define QNX_PROC_STATS          "stats"
 
 
 #define QNX_DRIVER_DATA(sf) ((struct qnx_driver_data*)sf->private) 
@@ -36,12 +37,13 @@ qnx_show_connections(struct seq_file *buf, void *v)
 {
    struct qnx_driver_data* data = QNX_DRIVER_DATA(buf);
    struct qnx_process_entry* entry;
+   int bkt;
    
    int have_output = 0;
    
    rcu_read_lock();
 
-   list_for_each_entry_rcu(entry, &data->process_entries, hook)
+   hash_for_each_rcu(data->process_entries, bkt, entry, hook)
    {
       if (!qnx_connection_table_is_empty(&entry->connections))
       {      
@@ -64,48 +66,83 @@ qnx_show_connections(struct seq_file *buf, void *v)
 }
 
 
+struct reply_blocked_args
+{
+   struct seq_file* buf;
+   pid_t pid;
+   int have_output;
+};
+
+
+static void
+show_reply_blocked(struct qnx_internal_msgsend* msg, void* arg)
+{
+   struct reply_blocked_args* args = (struct reply_blocked_args*)arg;
+   
+   args->have_output = 1;
+   seq_printf(args->buf, "tid=%d (coid=%d) => pid=%d, chid=%d [REPLY]\n", current_get_tid_nr(msg->task), msg->data.msg.coid, args->pid, msg->receiver_chid);
+}
+
+
+struct send_blocked_args
+{
+   struct seq_file* buf;
+   pid_t pid;
+   int chid;
+   int have_output;
+};
+
+
+static void
+show_send_blocked(struct qnx_internal_msgsend* msg, void* arg)
+{
+   struct send_blocked_args* args = (struct send_blocked_args*)arg;
+   
+   if (msg->task)
+   {
+      args->have_output = 1;
+      seq_printf(args->buf, "tid=%d (coid=%d) => pid=%d, chid=%d [SEND]\n", current_get_tid_nr(msg->task), msg->data.msg.coid, args->pid, args->chid);
+   }
+}
+
+
 static int 
 qnx_show_blocked_tasks(struct seq_file *buf, void *v)
 {
    struct qnx_driver_data* data = QNX_DRIVER_DATA(buf);
    struct qnx_process_entry* entry;
+   int bkt;
+   struct reply_blocked_args reply_blocked = { 0 };
+   struct send_blocked_args send_blocked = { 0 };
    
    int have_output = 0;
    
    rcu_read_lock();
 
-   list_for_each_entry_rcu(entry, &data->process_entries, hook)
+   hash_for_each_rcu(data->process_entries, bkt, entry, hook)
    {
       // waiting - send blocked
       struct qnx_channel* chnl;
-      struct qnx_internal_msgsend* msg;
          
       list_for_each_entry_rcu(chnl, &entry->channels, hook)
       {
+         send_blocked.buf = buf;
+         send_blocked.pid = entry->pid;
+         send_blocked.chid = chnl->chid;
+         
          spin_lock(&chnl->waiting_lock);
-
-         list_for_each_entry(msg, &chnl->waiting, hook)
-         {
-            if (msg->task)
-            {
-               have_output = 1;
-               seq_printf(buf, "tid=%d (coid=%d) => pid=%d, chid=%d [SEND]\n", current_get_tid_nr(msg->task), msg->data.msg.coid, entry->pid, chnl->chid);
-            }
-         }
-
+         qnx_channel_take_incoming(chnl);
+         qnx_msg_queue_for_each(&chnl->waiting, &show_send_blocked, &send_blocked);
          spin_unlock(&chnl->waiting_lock);
       }
       
       // pending - reply blocked         
-      spin_lock(&entry->pending_lock);
-
-      list_for_each_entry(msg, &entry->pending, hook)
-      {
-         have_output = 1;
-         seq_printf(buf, "tid=%d (coid=%d) => pid=%d, chid=%d [REPLY]\n", current_get_tid_nr(msg->task), msg->data.msg.coid, entry->pid, msg->receiver_chid);
-      }
-
-      spin_unlock(&entry->pending_lock);
+      reply_blocked.buf = buf;
+      reply_blocked.pid = entry->pid;
+      
+      qnx_pending_table_for_each(&entry->pending, &show_reply_blocked, &reply_blocked);
+      
+      have_output |= reply_blocked.have_output | send_blocked.have_output;
    }
          
    rcu_read_unlock();
@@ -122,12 +159,13 @@ qnx_show_channels(struct seq_file *buf, void *v)
 {
    struct qnx_driver_data* data = QNX_DRIVER_DATA(buf);
    struct qnx_process_entry* entry;
+   int bkt;
    
    int have_output = 0;
    
    rcu_read_lock();
       
-   list_for_each_entry_rcu(entry, &data->process_entries, hook)
+   hash_for_each_rcu(data->process_entries, bkt, entry, hook)
    {
       if (!list_empty(&entry->channels))
       {
@@ -154,6 +192,15 @@ qnx_show_channels(struct seq_file *buf, void *v)
 }
 
 
+static int 
+qnx_show_stats(struct seq_file *buf, void *v)
+{
+   seq_printf(buf, "allocations: %lu\n", qnx_internal_msgsend_get_allocations());
+   
+   return 0;
+}
+
+
 static int
 qnx_open(struct inode *inode, struct file *file)
 {
@@ -169,6 +216,10 @@ qnx_open(struct inode *inode, struct file *file)
    {
       return single_open(file, qnx_show_blocked_tasks, PDE_DATA(inode));
    }
+   else if (!strncmp(QNX_PROC_STATS, file->f_path.dentry->d_name.name, 2))
+   {
+      return single_open(file, qnx_show_stats, PDE_DATA(inode));
+   }
    else
       return 0;
 }
@@ -191,7 +242,8 @@ int qnx_proc_init(struct qnx_driver_data* data)
    if ((dir = proc_mkdir(QNX_PROC_ROOT_DIR, 0))
        && proc_create_data(QNX_PROC_CONNECTIONS, 0664, dir, &fops, data)
        && proc_create_data(QNX_PROC_CHANNELS, 0664, dir, &fops, data)
-       && proc_create_data(QNX_PROC_BLOCKED_TASKS, 0664, dir, &fops, data))
+       && proc_create_data(QNX_PROC_BLOCKED_TASKS, 0664, dir, &fops, data)
+       && proc_create_data(QNX_PROC_STATS, 0444, dir, &fops, data))
       return 1;
    
    remove_proc_subtree(QNX_PROC_ROOT_DIR, 0);
@@ -7,40 +7,37 @@
 #include "connection.h"
 #include "internal_msgsend.h"
 #include "driver_data.h"
+#include "submit_ring.h"
 #include "qnxcomm_internal.h"
 
 
-static inline
-int get_num_channels_unlocked(struct qnx_process_entry* entry)
+int qnx_process_entry_init(struct qnx_process_entry* entry, struct qnx_driver_data* driver)
 {
-   int rc = 0;
-   struct qnx_channel* chnl;
+   int rc;
    
-   list_for_each_entry(chnl, &entry->channels, hook)
-   {
-      ++rc;
-   }
+   // the only part that allocates, so there is nothing to undo on failure
+   rc = qnx_connection_table_init(&entry->connections);
+   if (unlikely(rc))
+      return rc;
    
-   return rc;
-}
-
-
-void qnx_process_entry_init(struct qnx_process_entry* entry, struct qnx_driver_data* driver)
-{
    kref_init(&entry->refcnt);
    entry->pid = current_get_pid_nr(current);
 
-   qnx_connection_table_init(&entry->connections);
+   qnx_pending_table_init(&entry->pending);
+   qnx_prio_boosts_init(&entry->boosts);
    
    INIT_LIST_HEAD(&entry->channels);
-   INIT_LIST_HEAD(&entry->pending);
+   entry->num_channels = 0;
    INIT_LIST_HEAD(&entry->pollfds);
+   INIT_LIST_HEAD(&entry->rings);
    
    spin_lock_init(&entry->channels_lock);
-   spin_lock_init(&entry->pending_lock);   
    spin_lock_init(&entry->pollfds_lock);
+   spin_lock_init(&entry->rings_lock);
    
    entry->driver = driver;
+   
+   return 0;
 }
 
 
@@ -48,50 +45,45 @@ static
 void qnx_process_entry_free(struct kref* refcount)
 {
    struct qnx_process_entry* entry = container_of(refcount, struct qnx_process_entry, refcnt);
+   struct qnx_channel* chnl;
+   struct qnx_channel* next;
+   
+   LIST_HEAD(msgs);
    
-   struct list_head *iter, *next;
-
    pr_debug("qnx_process_entry_free called\n");
  
-   spin_lock(&entry->channels_lock);
-   
-   while(!list_empty(&entry->channels))
-   {
-      struct qnx_channel* chnl;
-      pr_debug("releasing channel...\n");
+   while(!list_empty(&entry->rings))
+      qnx_process_entry_remove_ring(entry, list_first_entry(&entry->rings, struct qnx_submit_ring, proc_hook)->coid);
  
-      chnl = list_first_entry(&entry->channels, struct qnx_channel, hook);
-      list_del_rcu(&chnl->hook);
-      
-      synchronize_rcu();      
-      qnx_channel_release(chnl);
+   // nobody else modifies the list any more, so no need for the lock
+   list_for_each_entry(chnl, &entry->channels, hook)
+   {
+      qnx_driver_data_unregister_channel(entry->driver, entry->pid, chnl->chid);
+      qnx_channel_destroy(chnl, &msgs);
    }
    
-   spin_unlock(&entry->channels_lock);
+   qnx_pending_table_cleanup(&entry->pending, &msgs);
+   qnx_pending_table_destroy(&entry->pending);
    
-   pr_debug("channels done\n");
- 
-   spin_lock(&entry->pending_lock);
-   
-   list_for_each_safe(iter, next, &entry->pending)
-   {  
-      pr_debug("pending...\n");
-     
-      qnx_internal_msgsend_cleanup_and_free(list_entry(iter, struct qnx_internal_msgsend, hook));
-      list_del(iter);      
-   }
+   // all blocked senders at once, before the noreply messages go back to the channels' pools
+   qnx_internal_msgsend_cleanup_and_free_all(&msgs);
    
-   spin_unlock(&entry->pending_lock);  
+   pr_debug("senders done\n");
    
-   pr_debug("pendings done\n");
+   // channels, connections and the entry itself are freed after a grace period,
+   // so there's no need to wait for the /proc readers here
+   list_for_each_entry_safe(chnl, next, &entry->channels, hook)
+   {
+      list_del_rcu(&chnl->hook);
+      qnx_channel_release(chnl);
+   }
  
    qnx_connection_table_destroy(&entry->connections);
+   qnx_prio_boosts_destroy(&entry->boosts);
    
-   pr_debug("finished\n");
- 
-   kfree(entry);
+   kfree_rcu(entry, rcu);
    
-   pr_debug("really finished\n");
+   pr_debug("finished\n");
 }
 
 
@@ -103,31 +95,27 @@ void qnx_process_entry_release(struct qnx_process_entry* entry)
 
 int qnx_process_entry_remove_channel(struct qnx_process_entry* entry, int chid)
 {
-   int rc = -EINVAL;
+   struct qnx_channel* chnl = qnx_driver_data_unregister_channel(entry->driver, entry->pid, chid);
    
-   struct list_head* iter;
-   struct qnx_channel* chnl = 0;
+   LIST_HEAD(msgs);
+   
+   if (unlikely(!chnl))
+      return -EINVAL;
    
    spin_lock(&entry->channels_lock);
    
-   list_for_each(iter, &entry->channels)
-   {
-      chnl = list_entry(iter, struct qnx_channel, hook);
-      if (chnl->chid == chid)
-      {
-         list_del_rcu(iter);
-          
-         synchronize_rcu();        
-         qnx_channel_release(chnl);
-         
-         rc = 0;
-         break;
-      }    
-   }
+   list_del_rcu(&chnl->hook);
+   --entry->num_channels;
    
    spin_unlock(&entry->channels_lock);
    
-   return rc;
+   qnx_channel_destroy(chnl, &msgs);
+   qnx_internal_msgsend_cleanup_and_free_all(&msgs);
+   
+   // lookups which still see the channel fail to get a reference once the count dropped to zero
+   qnx_channel_release(chnl);
+   
+   return 0;
 }
 
 
@@ -170,9 +158,7 @@ int qnx_process_entry_remove_pollfd(struct qnx_process_entry* entry, struct file
       if (pollfd->file == f)
       {
          list_del_rcu(iter);
-         
-         synchronize_rcu();
-         kfree(pollfd);
+         kfree_rcu(pollfd, rcu);
          
          rc = 0;   
          break;
@@ -185,67 +171,84 @@ int qnx_process_entry_remove_pollfd(struct qnx_process_entry* entry, struct file
 }
 
 
-void qnx_process_entry_add_pending(struct qnx_process_entry* entry, struct qnx_internal_msgsend* data)
+int qnx_process_entry_add_pending(struct qnx_process_entry* entry, struct qnx_internal_msgsend* data)
 {
-   spin_lock(&entry->pending_lock);
-      
-   list_add(&data->hook, &entry->pending);
-   data->state = QNX_STATE_PENDING;
+   int rc = qnx_pending_table_add(&entry->pending, data);
    
-   spin_unlock(&entry->pending_lock);
+   // the caller fails the request
+   if (unlikely(rc))
+      qnx_prio_boosts_release(&entry->boosts, data);
+      
+   return rc;
 }
 
 
 struct qnx_internal_msgsend* qnx_process_entry_release_pending(struct qnx_process_entry* entry, int rcvid)
 {
-   struct qnx_internal_msgsend* iter;
-   
-   spin_lock(&entry->pending_lock);
-   
-   list_for_each_entry(iter, &entry->pending, hook) 
-   {
-      if (iter->rcvid == rcvid)
-      {
-         list_del(&iter->hook);
-         goto out;
-      }
-   }  
-    
-   iter = 0;
+   struct qnx_internal_msgsend* data = qnx_pending_table_remove(&entry->pending, rcvid);
    
-out:    
+   // replied, failed or taken back by the sender, the receiver owes nothing any more
+   if (data)
+      qnx_prio_boosts_release(&entry->boosts, data);
+      
+   return data;
+}
 
-   spin_unlock(&entry->pending_lock);
-   
-   return iter;
+
+struct qnx_internal_msgsend* qnx_process_entry_read_pending(struct qnx_process_entry* entry, int rcvid)
+{
+   return qnx_pending_table_get_reader(&entry->pending, rcvid);
 }
 
 
-int qnx_process_entry_add_channel(struct qnx_process_entry* entry)
+int qnx_process_entry_add_channel(struct qnx_process_entry* entry, unsigned int flags)
 {   
-   int rc = -ENOMEM;   
+   int rc = 0;   
    
    // we expect that the upper bound 'qnx_max_channels_per_process' is seldomly reached...
    struct qnx_channel* chnl = (struct qnx_channel*)kmalloc(sizeof(struct qnx_channel), GFP_USER);
+   if (unlikely(!chnl))
+      return -ENOMEM;
+      
+   rc = qnx_channel_init(chnl, flags, entry->pid);
+   if (unlikely(rc < 0))
+   {
+      kfree(chnl);
+      return rc;
+   }
+
+   spin_lock(&entry->channels_lock);      
+   
+   if (likely(entry->num_channels < qnx_max_channels_per_process))
+   {   
+      ++entry->num_channels;
+   }
+   else
+      rc = -EMFILE;
+   
+   spin_unlock(&entry->channels_lock);
    
-   if (likely(chnl))
+   if (unlikely(rc < 0))
    {
-      rc = qnx_channel_init(chnl);
+      qnx_channel_release(chnl);
+      return rc;
+   }
    
-      spin_lock(&entry->channels_lock);      
-      
-      if (likely(get_num_channels_unlocked(entry) < qnx_max_channels_per_process))
-      {   
-         list_add_rcu(&chnl->hook, &entry->channels);         
-      }
-      else
-         rc = -EMFILE;
+   rc = qnx_driver_data_register_channel(entry->driver, chnl);
       
-      spin_unlock(&entry->channels_lock);
-      
-      if (rc < 0)
-         kfree(chnl);
+   spin_lock(&entry->channels_lock);      
+   
+   if (likely(rc > 0))
+   {
+      list_add_rcu(&chnl->hook, &entry->channels);         
    }
+   else
+      --entry->num_channels;
+      
+   spin_unlock(&entry->channels_lock);
+   
+   if (unlikely(rc < 0))
+      qnx_channel_release(chnl);
    
    return rc;
 }
@@ -253,25 +256,7 @@ int qnx_process_entry_add_channel(struct qnx_process_entry* entry)
 
 struct qnx_channel* qnx_process_entry_find_channel(struct qnx_process_entry* entry, int chid)
 {
-   struct qnx_channel* chnl;
-
-   rcu_read_lock();
-   
-   list_for_each_entry_rcu(chnl, &entry->channels, hook) 
-   {
-      if (chnl->chid == chid)   
-      {            
-         kref_get(&chnl->refcnt);       
-         goto out;
-      }
-   }
-   
-   chnl = 0;
-   
-out:   
-   rcu_read_unlock();
-    
-   return chnl;
+   return qnx_driver_data_find_channel(entry->driver, entry->pid, chid);
 }
 
 
@@ -303,20 +288,10 @@ out:
 
 int qnx_process_entry_is_channel_available(struct qnx_process_entry* entry, int chid)
 {
-   struct qnx_channel* chnl;  
-   
-   rcu_read_lock();
+   struct qnx_channel* chnl = qnx_process_entry_find_channel(entry, chid);  
    
-   list_for_each_entry_rcu(chnl, &entry->channels, hook)
-   {
-      if (chnl->chid == chid)
-         goto out;
-   }
-   
-   chnl = 0;
-   
-out:
-   rcu_read_unlock();
+   if (chnl)
+      qnx_channel_release(chnl);
    
    return chnl?1:0;
 }
@@ -325,20 +300,32 @@ out:
 int qnx_process_entry_add_connection(struct qnx_process_entry* entry, struct qnx_io_attach* att_data)
 {
    int rc;
+   struct qnx_channel* chnl;
    
    struct qnx_process_entry* proc = qnx_driver_data_find_process(entry->driver, att_data->pid);
    if (proc)
    {      
-      if (qnx_process_entry_is_channel_available(proc, att_data->chid))
+      // the connection keeps the channel, so sending needs no further lookup
+      chnl = qnx_process_entry_find_channel(proc, att_data->chid);
+      if (chnl)
       {
          struct qnx_connection* conn = (struct qnx_connection*)kmalloc(sizeof(struct qnx_connection), GFP_USER);
          if (conn)
          {
-            qnx_connection_init(conn, att_data->pid, att_data->chid);
+            qnx_connection_init(conn, att_data->pid, att_data->chid, att_data->flags, chnl);
+            
             rc = qnx_connection_table_add(&entry->connections, conn);
+            if (unlikely(rc < 0))
+            {
+               kfree(conn);
+               qnx_channel_release(chnl);
+            }
          }
          else
+         {
+            qnx_channel_release(chnl);
             rc = -ENOMEM;
+         }
       }
       else
          rc = -ESRCH;
@@ -354,11 +341,137 @@ int qnx_process_entry_add_connection(struct qnx_process_entry* entry, struct qnx
 
 int qnx_process_entry_remove_connection(struct qnx_process_entry* entry, int coid)
 {
+   if (unlikely(!list_empty(&entry->rings)))
+      qnx_process_entry_remove_ring(entry, coid);
+      
    return qnx_connection_table_remove(&entry->connections, coid);
 }
 
 
+struct qnx_submit_ring* qnx_process_entry_add_ring(struct qnx_process_entry* entry, int coid, int* rc)
+{
+   pid_t pid;
+   struct qnx_channel* chnl;
+   struct qnx_submit_ring* ring;
+   struct qnx_submit_ring* iter;
+   
+   chnl = qnx_connection_table_get_channel(&entry->connections, coid, &pid, 0);
+   if (unlikely(!chnl))
+   {
+      *rc = -EBADF;
+      return 0;
+   }
+   
+   ring = qnx_submit_ring_create(entry->pid, coid, pid, chnl->chid);
+   if (unlikely(!ring))
+   {
+      *rc = -ENOMEM;
+      goto out;
+   }
+   
+   spin_lock(&entry->rings_lock);
+   
+   list_for_each_entry(iter, &entry->rings, proc_hook)
+   {
+      if (iter->coid == coid)
+      {
+         spin_unlock(&entry->rings_lock);
+         
+         qnx_submit_ring_release(ring);
+         ring = 0;
+         
+         *rc = -EBUSY;
+         goto out;
+      }
+   }
+   
+   // one reference for the process list, one for the caller
+   kref_get(&ring->refcnt);
+   list_add_tail(&ring->proc_hook, &entry->rings);
+   
+   spin_unlock(&entry->rings_lock);
+   
+   qnx_channel_add_ring(chnl, ring);
+   *rc = 0;
+   
+out:
+   qnx_channel_release(chnl);
+   
+   return ring;
+}
+
+
+struct qnx_submit_ring* qnx_process_entry_find_ring(struct qnx_process_entry* entry, int coid)
+{
+   struct qnx_submit_ring* ring;
+   
+   spin_lock(&entry->rings_lock);
+   
+   list_for_each_entry(ring, &entry->rings, proc_hook)
+   {
+      if (ring->coid == coid)
+      {
+         kref_get(&ring->refcnt);
+         goto out;
+      }
+   }
+   
+   ring = 0;
+   
+out:
+   spin_unlock(&entry->rings_lock);
+   
+   return ring;
+}
+
+
+void qnx_process_entry_remove_ring(struct qnx_process_entry* entry, int coid)
+{
+   struct qnx_submit_ring* ring;
+   struct qnx_channel* chnl;
+   
+   spin_lock(&entry->rings_lock);
+   
+   list_for_each_entry(ring, &entry->rings, proc_hook)
+   {
+      if (ring->coid == coid)
+      {
+         list_del_init(&ring->proc_hook);
+         goto out;
+      }
+   }
+   
+   ring = 0;
+   
+out:
+   spin_unlock(&entry->rings_lock);
+   
+   if (!ring)
+      return;
+      
+   // a destroyed channel dropped the ring already, even if connections still keep it 
+   // alive, and it can't be found anymore. If the chid got reused meanwhile, the new 
+   // channel never had the ring, qnx_channel_remove_ring sees it is not attached.
+   chnl = qnx_driver_data_find_channel(entry->driver, ring->receiver_pid, ring->chid);
+   if (chnl)
+   {
+      // the entries were accepted already, they are delivered like the ones sent by ioctl
+      qnx_channel_flush_ring(chnl, ring);
+      qnx_channel_remove_ring(chnl, ring);
+      qnx_channel_release(chnl);
+   }
+   
+   qnx_submit_ring_release(ring);
+}
+
+
 struct qnx_connection qnx_process_entry_find_connection(struct qnx_process_entry* entry, int coid)
 {
    return qnx_connection_table_retrieve(&entry->connections, coid);
 }
+
+
+struct qnx_channel* qnx_process_entry_find_connection_channel(struct qnx_process_entry* entry, int coid, pid_t* pid, int* flags)
+{
+   return qnx_connection_table_get_channel(&entry->connections, coid, pid, flags);
+}
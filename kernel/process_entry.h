@@ -8,6 +8,8 @@
 #include <linux/kref.h>
 
 #include "connection_table.h"
+#include "pending_table.h"
+#include "prio_boost.h"
 #include "qnxcomm_driver.h"
 
 
@@ -15,38 +17,44 @@
 struct qnx_driver_data;
 struct qnx_internal_msgsend;
 struct qnx_channel;
+struct qnx_submit_ring;
 
 struct qnx_process_entry
 {
-   struct list_head hook;
+   struct hlist_node hook;
    struct kref refcnt;
    
    pid_t pid;
    
    struct list_head channels;
+   int num_channels;
    struct qnx_connection_table connections;
-   struct list_head pending;
+   struct qnx_pending_table pending;
+   struct qnx_prio_boosts boosts;
    struct list_head pollfds;
+   struct list_head rings;
       
    spinlock_t channels_lock;  
-   spinlock_t pending_lock;
    spinlock_t pollfds_lock;
+   spinlock_t rings_lock;
    
    struct qnx_driver_data* driver;
+   
+   struct rcu_head rcu;   ///< readers may still walk the entry after it was freed
 };
 
 
 // ---------------------------------------------------------------------
 
 
-/// constructor and destructor
-void qnx_process_entry_init(struct qnx_process_entry* entry, struct qnx_driver_data* driver);
+/// constructor and destructor, the constructor fails if the connection table cannot be set up
+int qnx_process_entry_init(struct qnx_process_entry* entry, struct qnx_driver_data* driver);
 
 void qnx_process_entry_release(struct qnx_process_entry* entry);
 
 
 /// channel management
-int qnx_process_entry_add_channel(struct qnx_process_entry* entry);
+int qnx_process_entry_add_channel(struct qnx_process_entry* entry, unsigned int flags);
 
 int qnx_process_entry_remove_channel(struct qnx_process_entry* entry, int chid);
 
@@ -70,11 +78,27 @@ int qnx_process_entry_remove_connection(struct qnx_process_entry* entry, int coi
 
 struct qnx_connection qnx_process_entry_find_connection(struct qnx_process_entry* entry, int coid);
 
+/// the send path, returns the referenced target channel and optionally the receiver's pid and the connection flags
+struct qnx_channel* qnx_process_entry_find_connection_channel(struct qnx_process_entry* entry, int coid, pid_t* pid, int* flags);
+
+
+/// submission rings management, find and add return a referenced ring
+struct qnx_submit_ring* qnx_process_entry_add_ring(struct qnx_process_entry* entry, int coid, int* rc);
+
+struct qnx_submit_ring* qnx_process_entry_find_ring(struct qnx_process_entry* entry, int coid);
+
+/// hands the entries not yet consumed over to the receiving channel
+void qnx_process_entry_remove_ring(struct qnx_process_entry* entry, int coid);
+
 
 /// pending requests management
-void qnx_process_entry_add_pending(struct qnx_process_entry* entry, struct qnx_internal_msgsend* data);
+/// -ENOMEM if the request couldn't be added, the caller must fail it then
+int qnx_process_entry_add_pending(struct qnx_process_entry* entry, struct qnx_internal_msgsend* data);
 
 struct qnx_internal_msgsend* qnx_process_entry_release_pending(struct qnx_process_entry* entry, int rcvid);
 
+/// for MsgRead, the request stays pending, the caller must decrement its readers count when done
+struct qnx_internal_msgsend* qnx_process_entry_read_pending(struct qnx_process_entry* entry, int rcvid);
+
 
 #endif   // __QNXCOMM_PROCESS_ENTRY_H
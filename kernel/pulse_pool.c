@@ -0,0 +1,107 @@
+#include "pulse_pool.h"
+#include "internal_msgsend.h"
+#include "qnxcomm_internal.h"
+
+
+void qnx_pulse_pool_init(struct qnx_pulse_pool* pool)
+{
+   INIT_LIST_HEAD(&pool->free);
+   spin_lock_init(&pool->lock);
+
+   pool->num_free = 0;
+   atomic_set(&pool->num_used, 0);
+}
+
+
+void qnx_pulse_pool_destroy(struct qnx_pulse_pool* pool)
+{
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+
+   list_for_each_entry_safe(data, next, &pool->free, hook)
+   {
+      qnx_internal_msgsend_free_pulse(data);
+   }
+
+   INIT_LIST_HEAD(&pool->free);
+   pool->num_free = 0;
+}
+
+
+/// same as the noreply limit, 0 means unlimited
+static inline
+int reserve(struct qnx_pulse_pool* pool)
+{
+   int budget = (int)qnx_max_pulses_per_channel;
+   int num = atomic_read(&pool->num_used);
+   int old;
+
+   for(;;)
+   {
+      if (unlikely(budget > 0 && num >= budget))
+         return 0;
+
+      old = atomic_cmpxchg(&pool->num_used, num, num + 1);
+      if (likely(old == num))
+         return 1;
+
+      num = old;
+   }
+}
+
+
+int qnx_pulse_pool_get(struct qnx_pulse_pool* pool, struct qnx_internal_msgsend** data)
+{
+   if (unlikely(!reserve(pool)))
+      return -EAGAIN;
+
+   *data = 0;
+
+   spin_lock(&pool->lock);
+
+   if (likely(!list_empty(&pool->free)))
+   {
+      *data = list_first_entry(&pool->free, struct qnx_internal_msgsend, hook);
+      list_del(&(*data)->hook);
+      --pool->num_free;
+   }
+
+   spin_unlock(&pool->lock);
+
+   if (unlikely(!*data))
+   {
+      *data = qnx_internal_msgsend_alloc_pulse();
+      if (unlikely(!*data))
+      {
+         atomic_dec(&pool->num_used);
+         return -ENOMEM;
+      }
+   }
+
+   (*data)->pool = 0;
+   (*data)->pulse_pool = pool;
+
+   return 0;
+}
+
+
+void qnx_pulse_pool_put(struct qnx_pulse_pool* pool, struct qnx_internal_msgsend* data)
+{
+   int cached = 0;
+
+   spin_lock(&pool->lock);
+
+   if (pool->num_free < QNX_PULSE_POOL_CACHED)
+   {
+      list_add(&data->hook, &pool->free);   // LIFO, the last used descriptor is still cache hot
+      ++pool->num_free;
+      cached = 1;
+   }
+
+   spin_unlock(&pool->lock);
+
+   if (!cached)
+      qnx_internal_msgsend_free_pulse(data);
+
+   atomic_dec(&pool->num_used);
+}
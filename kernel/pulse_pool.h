@@ -0,0 +1,51 @@
+#ifndef __QNXCOMM_PULSE_POOL_H
+#define __QNXCOMM_PULSE_POOL_H
+
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/atomic.h>
+
+
+// forward decls
+struct qnx_internal_msgsend;
+
+
+/// recycled descriptors kept per channel, the rest goes back to the slab
+#define QNX_PULSE_POOL_CACHED 32
+
+
+/**
+ * Pulse descriptors of a channel. They are compact (QNX_PULSE_MSGSEND_SIZE)
+ * and recycled, and the number in use is limited by the module parameter
+ * @c pulses_per_channel, so a fast producer can't exhaust the kernel's memory.
+ * The pool must outlive all its descriptors, i.e. it is destroyed when the
+ * channel is freed.
+ */
+struct qnx_pulse_pool
+{
+   struct list_head free;
+   spinlock_t lock;
+   unsigned int num_free;
+
+   atomic_t num_used;   ///< queued or being received
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// construction/destruction
+void qnx_pulse_pool_init(struct qnx_pulse_pool* pool);
+
+void qnx_pulse_pool_destroy(struct qnx_pulse_pool* pool);
+
+
+/// -EAGAIN if the channel's pulse budget is used up, the descriptor must be initialized as pulse
+int qnx_pulse_pool_get(struct qnx_pulse_pool* pool, struct qnx_internal_msgsend** data);
+
+/// called by qnx_internal_msgsend_free
+void qnx_pulse_pool_put(struct qnx_pulse_pool* pool, struct qnx_internal_msgsend* data);
+
+
+#endif   // __QNXCOMM_PULSE_POOL_H
@@ -14,6 +14,9 @@
 #include "channel.h"
 #include "driver_data.h"
 #include "proc.h"
+#include "remote_copy.h"
+#include "msgsend_pool.h"
+#include "submit_ring.h"
 
 
 MODULE_LICENSE("GPL");
@@ -23,12 +26,6 @@ MODULE_DESCRIPTION("QNX like message passing for the Linux kernel");
 
 #define QNX_PROC_ENTRY(f) ((struct qnx_process_entry*)f->private_data)
 
-#define QNX_CONN_IS_VALID(conn) (conn.chid > 0)
-
-#define QNX_FREE_IF_NOT(ptr, stack_buf) \
-   if (ptr != stack_buf && ptr != 0)    \
-      kfree(ptr);
-
 
 static struct qnx_driver_data driver_data;
 static dev_t dev_number;
@@ -37,10 +34,14 @@ static struct class* the_class;
 static struct device* dev;
 
 int qnx_max_connections_per_process = 256;    ///< like max number of open files
-int qnx_max_channels_per_process = 64;        ///< same for channels
+int qnx_max_channels_per_process = INT_MAX;   ///< same for channels, only limited by memory by default
 
 uint qnx_max_noreply_msg_size = 4096;         ///< max message size for noreply messages
 uint qnx_max_noreply_msg_num = 128;           ///< number of enqueued noreply messages per channel
+uint qnx_noreply_low_watermark = 0;           ///< fill level which fires noreply notifications, 0 for half of noreply_per_channel
+uint qnx_direct_copy_min_size = 4096;         ///< MsgSend(v) payloads of this size are not copied to the kernel, 0 to disable
+uint qnx_lockfree_enqueue = 1;                ///< senders enqueue without taking the channel's lock, 0 to use the lock
+uint qnx_max_pulses_per_channel = 4096;       ///< number of pulses queued per channel, 0 for unlimited
 
 
 int set_max_connetions(const char *val, const struct kernel_param *kp)
@@ -73,88 +74,152 @@ module_param_cb(max_connections, &ops, &qnx_max_connections_per_process, 0644);
 module_param_cb(max_channels, &ops, &qnx_max_channels_per_process, 0644);
 module_param_named(noreply_max_size, qnx_max_noreply_msg_size, uint, 0644);
 module_param_named(noreply_per_channel, qnx_max_noreply_msg_num, uint, 0644);
+module_param_named(noreply_low_watermark, qnx_noreply_low_watermark, uint, 0644);
+module_param_named(direct_copy_min_size, qnx_direct_copy_min_size, uint, 0644);
+module_param_named(lockfree_enqueue, qnx_lockfree_enqueue, uint, 0644);
+module_param_named(pulses_per_channel, qnx_max_pulses_per_channel, uint, 0644);
 
 
 // ---------------------------------------------------------------------
 
 
+/// messages passed by ioctl must not overtake those still queued in the connection's submission ring
+static inline
+void flush_submit_ring(struct qnx_process_entry* entry, struct qnx_channel* chnl, int coid)
+{
+   struct qnx_submit_ring* ring;
+   
+   if (likely(list_empty(&entry->rings)))
+      return;
+      
+   ring = qnx_process_entry_find_ring(entry, coid);
+   if (ring)
+   {
+      qnx_channel_flush_ring(chnl, ring);
+      qnx_submit_ring_release(ring);
+   }
+}
+
+
+/**
+ * Called when a blocked sender gives up (timeout or signal). Sleeps until 
+ * the request is either taken back or finished, so the sender's buffers 
+ * are no longer in use afterwards.
+ * 
+ * @return @c rc if the request was taken back, else the status of the reply
+ */
+static
+int cancel_msgsend(struct qnx_channel* chnl, struct qnx_internal_msgsend* send_data, int rc)
+{
+   struct qnx_process_entry* entry;
+   int taken = 0;
+   
+   // still queued, O(1)
+   if (qnx_channel_cancel_message(chnl, send_data))
+      return rc;
+   
+   // MsgReceive is running, wait until the request is pending (or finished on error)
+   if (cmpxchg(&send_data->state, QNX_STATE_RECEIVING, QNX_STATE_CANCELLING) == QNX_STATE_RECEIVING)
+      wait_event(send_data->reply_queue, ACCESS_ONCE(send_data->state) != QNX_STATE_CANCELLING);
+   
+   if (ACCESS_ONCE(send_data->state) == QNX_STATE_PENDING)
+   {
+      entry = qnx_driver_data_find_process(&driver_data, send_data->receiver_pid);
+      
+      if (entry)
+      {
+         // if we get it out of the table, nobody will reply any more
+         taken = qnx_process_entry_release_pending(entry, send_data->rcvid) != 0;
+         qnx_process_entry_release(entry);
+      }
+      
+      if (taken)
+         return rc;
+   }
+   
+   // MsgReply, MsgError or the receiver's teardown is about to finish the request
+   if (cmpxchg(&send_data->state, QNX_STATE_PENDING, QNX_STATE_CANCELLING) == QNX_STATE_PENDING)
+      wait_event(send_data->reply_queue, ACCESS_ONCE(send_data->state) == QNX_STATE_FINISHED);
+   
+   smp_rmb();
+   return send_data->status;
+}
+
+
+/**
+ * Waits for MsgReply until the deadline for the given blocking state(s) expires.
+ * 
+ * @return 0 if finished, -ETIME on timeout or -ERESTARTSYS
+ */
+static inline
+int wait_for_reply(struct qnx_internal_msgsend* send_data, int state)
+{
+   return wait_event_interruptible_hrtimeout(send_data->reply_queue, 
+          ACCESS_ONCE(send_data->state) == QNX_STATE_FINISHED, 
+          qnx_timeout_remaining(&send_data->data.msg.timeout, state));
+}
+
+
 static
 int handle_msgsend_internal_block(struct qnx_channel* chnl, struct qnx_internal_msgsend* send_data)
 {  
    int rc = 0;
+   int flags = send_data->data.msg.timeout.flags & (QNX_TIMEOUT_SEND | QNX_TIMEOUT_REPLY);
    
-   // set the state before it's getting scheduled out
-   set_current_state(TASK_INTERRUPTIBLE);
+   // the receiver tells us when we become reply blocked, the deadline starts to count from then on
+   send_data->wake_on_pending = (flags == QNX_TIMEOUT_REPLY);
    
-   qnx_channel_add_new_message(chnl, send_data); 
-   
-   pr_debug("MsgSend(v) with timeout=%d ms\n", send_data->data.msg.timeout_ms); 
-   
-   // now wait for MsgReply...   
-   if (send_data->data.msg.timeout_ms > 0)
+   // the receiver is woken up with a sync hint since we block right now
+   rc = qnx_channel_add_new_message(chnl, send_data); 
+   if (unlikely(rc))
    {
-      if (unlikely(msleep_interruptible(send_data->data.msg.timeout_ms) == 0))
-      {
-         printk("Timeout\n");
-         rc = -ETIMEDOUT;
-         goto interrupted;
-      }      
+      qnx_channel_release(chnl);
+      return rc;
    }
-   else
-      schedule();
    
-   // break if we got a signal
-   if (unlikely(signal_pending(current)))
+   pr_debug("MsgSend(v) with timeout flags=%x\n", flags); 
+   
+   if (unlikely(send_data->wake_on_pending))
    {
-      printk("signal\n");
-      rc = -ERESTARTSYS;
+      rc = wait_event_interruptible(send_data->reply_queue, 
+           ACCESS_ONCE(send_data->state) == QNX_STATE_PENDING || ACCESS_ONCE(send_data->state) == QNX_STATE_FINISHED);
+      
+      if (likely(rc == 0))
+         rc = wait_for_reply(send_data, QNX_TIMEOUT_REPLY);
    }
    else
    {
-      rc = send_data->status;
-      goto out;
-   }
-   
-interrupted:
-
-printk("interrupted\n");
-   if (!qnx_channel_remove_message(chnl, send_data->rcvid))
-   { 
-      struct qnx_process_entry* entry;
-      // object is out of the queue. it could be in the following states
-      //
-      // RECEIVING: the other side is currently running MsgReceive, at the end,
-      //            the object is in the pending state. We have to wait
-      //            for the object to get into RECEIVING state (1)
-      // PENDING: during this state, this thread may take the object 
-      //          out of the pending list. If the object is already in
-      //          the pending state we can either grab the object (2)
-      //          or wait for finish (3)
-      // FINISHED: MsgReply is called on the object, so we are free to continue (4)
-          
-      while(ACCESS_ONCE(send_data->state) == QNX_STATE_RECEIVING);   // (1) busy loop
-      
-      // object is already in processing
-      entry = qnx_driver_data_find_process(&driver_data, send_data->receiver_pid);
+      // send blocked and maybe reply blocked, too
+      rc = wait_for_reply(send_data, QNX_TIMEOUT_SEND);
       
-      if (entry)
-      {              
-         if (qnx_process_entry_release_pending(entry, send_data->rcvid) == 0)  
-         {       
-            rc = send_data->status;       // (2) it's obviously done...      
-         }
-         else   
-         {              
-            while(ACCESS_ONCE(send_data->state) == QNX_STATE_FINISHED);    // (3) busy loop
-            // finished (4)
+      // send blocked only, so the deadline does not apply any more once the message was received
+      if (unlikely(rc == -ETIME && flags == QNX_TIMEOUT_SEND))
+      {
+         if (qnx_channel_cancel_message(chnl, send_data))
+         {
+            rc = -ETIMEDOUT;
+            goto out;
          }
          
-         qnx_process_entry_release(entry);
+         rc = wait_for_reply(send_data, 0);
       }
    }
    
+   if (likely(rc == 0))
+   {
+      smp_rmb();
+      rc = send_data->status;
+      goto out;
+   }
+   
+   rc = cancel_msgsend(chnl, send_data, rc == -ETIME ? -ETIMEDOUT : -ERESTARTSYS);
+   
 out:   
    
+   // MsgRead may still copy from our buffers
+   if (unlikely(atomic_read(&send_data->readers) > 0))
+      qnx_internal_msgsend_wait_readers(send_data);
+   
    qnx_channel_release(chnl);
    
    return rc;
@@ -166,209 +231,214 @@ int handle_msgsendpulse(struct qnx_process_entry* entry, long data)
 {
    int rc;
    
-   struct qnx_connection conn;
-   struct qnx_channel* chnl = 0;
-         
-   // must allocate data (or reuse some other object)...         
-   struct qnx_internal_msgsend* snddata = (struct qnx_internal_msgsend*)kmalloc(sizeof(struct qnx_internal_msgsend), GFP_USER);
-   if (unlikely(!snddata))          
-   {
-      rc = -ENOMEM;                    
-      goto out;
-   }
-         
-   rc = qnx_internal_msgsend_init_pulse(snddata, (struct qnx_io_msgsendpulse*)data, entry->pid);
-   if (unlikely(rc))
-      goto out_free;
-         
-   pr_debug("MsgSendPulse coid=%d\n", snddata->data.pulse.coid);
-   conn = qnx_process_entry_find_connection(entry, snddata->data.pulse.coid);         
+   struct qnx_io_msgsendpulse io;
+   struct qnx_internal_msgsend* snddata;
+   struct qnx_channel* chnl;
+   
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_msgsendpulse))))
+      return -EFAULT;
          
-   if (unlikely(!QNX_CONN_IS_VALID(conn)))
-   {
-      rc = -EBADF;
-      goto out_free;
-   }
+   pr_debug("MsgSendPulse coid=%d\n", io.coid);
    
-   chnl = qnx_driver_data_find_channel(entry->driver, conn.pid, conn.chid);
+   chnl = qnx_process_entry_find_connection_channel(entry, io.coid, 0, 0);
    if (unlikely(!chnl))
-   {
-      rc = -EBADF;
-      goto out_free;
-   }         
+      return -EBADF;
+   
+   // the descriptor counts against the receiving channel's pulse budget
+   rc = qnx_pulse_pool_get(&chnl->pulses, &snddata);
+   if (unlikely(rc))
+      goto out_channel_release;
+      
+   qnx_internal_msgsend_init_pulse(snddata, &io, entry->pid);
         
-   qnx_channel_add_new_message(chnl, snddata);   
+   flush_submit_ring(entry, chnl, io.coid);
+   
+   rc = qnx_channel_add_new_message(chnl, snddata);   
+   if (unlikely(rc))
+      qnx_internal_msgsend_free(snddata);
+      
+out_channel_release:
+
    qnx_channel_release(chnl);   
    
-   rc = 0;
-   goto out;
-            
-out_free:
+   return rc;
+}
 
-   kfree(snddata);
-            
-out:            
 
-   return rc;
+/// priority of the ring's next entry
+static inline
+int ring_priority(struct qnx_submit_ring* ring)
+{
+   return clamp((int)ACCESS_ONCE(qnx_submit_ring_front(ring)->priority), 0, QNX_NUM_PRIORITIES - 1);
 }
 
 
+/**
+ * @param chnl the reference is released by this function
+ * @param timeout already copied from userspace
+ * @param out the receive buffer, the array already copied from userspace
+ * @param user_info where to copy the message info back to
+ * @param pulses MsgReceivePulse, messages are left in the queue
+ */
 static
-int handle_msgreceive(struct qnx_process_entry* entry, long data)
+int handle_msgreceive_internal(struct qnx_process_entry* entry, struct qnx_channel* chnl, const struct qnx_io_timeout* timeout, 
+                               const struct iovec* out, unsigned long out_len, struct _msg_info* user_info, int pulses)
 {
    int rc;
-   struct qnx_io_receive recv_data = { 0 };
-   struct qnx_channel* chnl;
    struct qnx_internal_msgsend* send_data;
-   struct list_head* ptr;
-   size_t bytes_to_copy;      
-      
-   if (unlikely(copy_from_user(&recv_data, (void*)data, sizeof(struct qnx_io_receive))))
-   {   
-      rc = -EFAULT;
-      goto out;
-   }        
-   
-   chnl = qnx_process_entry_find_channel(entry, recv_data.chid);
-   if (unlikely(!chnl))
-   {
-      rc = -EBADF;
-      goto out;
-   }
+   struct qnx_internal_msgsend ring_data;
+   struct qnx_submit_ring* ring = 0;
+   struct qnx_iov_iter iter;
+   struct _msg_info info;
+   size_t len = iov_length(out, out_len);
    
    //printk("num waiting: %d\n", atomic_read(&chnl->num_waiting));
    
-   rc = wait_event_interruptible_timeout(chnl->waiting_queue, 
-        atomic_read(&chnl->num_waiting) > 0, 
-        msecs_to_jiffies(recv_data.timeout_ms));
+again:
+   rc = qnx_channel_wait_for_messages(chnl, pulses, qnx_timeout_remaining(timeout, QNX_TIMEOUT_RECEIVE));
    
-   if (unlikely(rc < 0))
-   {
-      printk("rc<0\n");
-      rc = -ERESTARTSYS;
+   // on timeout the queue is checked once more below
+   if (unlikely(rc == -ERESTARTSYS))
       goto out_channel_release;
-   }
+   
+   // ring entries may be messages, so they are sorted into the queues first
+   if (unlikely(pulses) && unlikely(!list_empty(&chnl->rings)))
+      qnx_channel_flush_rings(chnl);
    
    spin_lock(&chnl->waiting_lock);
    
    //printk("now num waiting: %d\n", atomic_read(&chnl->num_waiting));
    
-   // empty?! maybe spurious wakeup here?!
-   if (list_empty(&chnl->waiting))
+   qnx_channel_take_incoming(chnl);
+   send_data = qnx_channel_first_message(chnl, pulses);
+   
+   // a ring entry only goes first if its priority is higher
+   if (unlikely(!list_empty(&chnl->rings)) && !pulses && (ring = qnx_channel_next_ring(chnl)))
+   {
+      if (send_data && ring_priority(ring) <= send_data->priority)
+         ring = 0;
+   }
+   
+   if (unlikely(ring))
+   {
+      // pulse or noreply message, so it never lives beyond this call
+      qnx_internal_msgsend_init_ring(&ring_data, ring);
+      send_data = &ring_data;
+   }
+   else if (likely(send_data))
+   {
+      qnx_channel_remove_message(chnl, send_data);
+   }
+   else
    {
-      pr_debug("Empty...\n");
       spin_unlock(&chnl->waiting_lock);      
       
+      // another receiver was faster, the deadline is checked by the next wait
+      if (rc == 0 && likely(!ACCESS_ONCE(chnl->destroyed)))
+         goto again;
+         
       rc = -ETIMEDOUT;
       goto out_channel_release;
    }
    
-   ptr = chnl->waiting.next;
-   atomic_dec(&chnl->num_waiting);   
-   
-   send_data = list_entry(ptr, struct qnx_internal_msgsend, hook);   
-   
-   // handle noreply message correctly
-   if (unlikely(send_data->rcvid > 0 && send_data->task == 0))
-      --chnl->num_waiting_noreply;
-   
-   list_del(ptr);
-   
    send_data->state = QNX_STATE_RECEIVING;
+   qnx_idle_receivers_served(&chnl->receivers, send_data->sender_pid, qnx_internal_msgsend_coid(send_data));
    
    spin_unlock(&chnl->waiting_lock);
    
    // assign meta information
-   memset(&recv_data.info, 0, sizeof(struct _msg_info));   
+   memset(&info, 0, sizeof(struct _msg_info));   
+   
+   info.pid = send_data->sender_pid;               
+   info.chid = chnl->chid;   
+   info.priority = send_data->priority;
    
-   recv_data.info.pid = send_data->sender_pid;               
-   recv_data.info.chid = chnl->chid;   
+   qnx_iov_iter_init(&iter, out, out_len, 0);
    
    // pulse or message?
    if (send_data->rcvid == 0)
    {      
       pr_debug("handling pulse\n");
       
-      recv_data.info.scoid = send_data->data.pulse.coid;            
-      recv_data.info.coid = send_data->data.pulse.coid;      
+      info.scoid = send_data->data.pulse.coid;            
+      info.coid = send_data->data.pulse.coid;      
             
-      recv_data.info.msglen = 2 * sizeof(int);
-      recv_data.info.srcmsglen = 2 * sizeof(int);
-      recv_data.info.dstmsglen = 0;
+      info.msglen = 2 * sizeof(int);
+      info.srcmsglen = 2 * sizeof(int);
+      info.dstmsglen = 0;
+      
+      rc = 0;
       
-      if (recv_data.out.iov_len >= sizeof(struct _pulse))
+      if (len >= sizeof(struct _pulse))
       {      
-         struct _pulse* pulse = (struct _pulse*)recv_data.out.iov_base;         
+         struct _pulse pulse;
          
-         int8_t code = send_data->data.pulse.code;         
-         int value = send_data->data.pulse.value;
-         int32_t scoid = send_data->data.pulse.coid;      
+         memset(&pulse, 0, sizeof(struct _pulse));
+         pulse.code = send_data->data.pulse.code;
+         pulse.value.sival_int = send_data->data.pulse.value;
+         pulse.scoid = send_data->data.pulse.coid;
          
-         if (put_user(code, &pulse->code) 
-            || put_user(scoid, &pulse->scoid) 
-            || copy_to_user(&pulse->value, &value, sizeof(int)))
-         {
+         if (qnx_iov_iter_copy_to_user(&iter, &pulse, sizeof(struct _pulse)))
             rc = -EFAULT;
-         }
-         else
-            rc = 0;
       }      
       
-      kfree(send_data);
+      if (send_data != &ring_data)
+         qnx_internal_msgsend_free(send_data);
+         
       send_data = 0;
    }
    else
    {
       pr_debug("handling message\n");
       
-      recv_data.info.scoid = send_data->data.msg.coid;      
-      recv_data.info.coid = send_data->data.msg.coid;      
-      
-      recv_data.info.msglen = send_data->data.msg.in.iov_len;      
-      recv_data.info.srcmsglen = send_data->data.msg.in.iov_len;      
-      recv_data.info.dstmsglen = send_data->data.msg.out.iov_len;
+      info.scoid = send_data->data.msg.coid;      
+      info.coid = send_data->data.msg.coid;      
       
-      // copy data
-      bytes_to_copy = min(send_data->data.msg.in.iov_len, recv_data.out.iov_len);
+      info.msglen = send_data->data.msg.in.iov_len;      
+      info.srcmsglen = send_data->data.msg.in.iov_len;      
+      info.dstmsglen = send_data->data.msg.out.iov_len;
       
-      if (unlikely(copy_to_user(recv_data.out.iov_base, send_data->data.msg.in.iov_base, bytes_to_copy)))
-      {
-         rc = -EFAULT;
-      }
-      else
+      // copy data, either from the kernel buffer or directly from the blocked sender
+      rc = qnx_internal_msgsend_read(send_data, 0, &iter, len);
+      if (likely(rc >= 0))
          rc = send_data->rcvid;
          
       if (!send_data->task)
       {
-         recv_data.info.flags |= QNX_FLAG_NOREPLY;
+         info.flags |= QNX_FLAG_NOREPLY;
    
-         // clean-up
-         qnx_internal_msgsend_destroy(send_data);
-         kfree(send_data);
+         // clean-up, the slot is free now
+         if (send_data != &ring_data)
+         {
+            qnx_internal_msgsend_free(send_data);
+            qnx_channel_noreply_consumed(chnl);
+         }
+            
          send_data = 0;
       }
    } 
    
-   if (rc >= 0 && copy_to_user((void*)data, &recv_data, sizeof(struct qnx_io_receive)))
+   if (rc >= 0 && copy_to_user(user_info, &info, sizeof(struct _msg_info)))
       rc = -EFAULT;
       
    if (send_data)
    {
       if (likely(rc > 0))
       {
-         qnx_process_entry_add_pending(entry, send_data);
+         // before the request is visible, a cancelling sender undoes the boost
+         if (chnl->flags & QNX_CHF_PRIO_INHERIT)
+            qnx_prio_boosts_acquire(&entry->boosts, send_data);
+         
+         // wakes up a cancelling sender or one with a reply blocked deadline
+         if (unlikely(qnx_process_entry_add_pending(entry, send_data)))
+            rc = -ENOMEM;
       }
-      else 
+      
+      if (unlikely(rc <= 0))
       {
-         send_data->reply.iov_base = 0;
-         send_data->reply.iov_len = 0;
-         
-         send_data->status = rc;
-         send_data->state = QNX_STATE_FINISHED;            
-
          // wake up the waiting process
          printk("wakeup error %p\n", send_data->task);
-         wake_up_process(send_data->task);            
+         qnx_internal_msgsend_finish(send_data, rc, 0);
       }
    }
               
@@ -378,52 +448,256 @@ out_channel_release:
 
    qnx_channel_release(chnl);
    
+   return rc;
+}
+
+
+static
+int handle_msgreceive(struct qnx_process_entry* entry, long data)
+{
+   struct qnx_io_receive recv_data;
+   struct qnx_channel* chnl;
+      
+   if (unlikely(copy_from_user(&recv_data, (void*)data, sizeof(struct qnx_io_receive))))
+      return -EFAULT;
+   
+   chnl = qnx_process_entry_find_channel(entry, recv_data.chid);
+   if (unlikely(!chnl))
+      return -EBADF;
+   
+   return handle_msgreceive_internal(entry, chnl, &recv_data.timeout, &recv_data.out, 1, &((struct qnx_io_receive*)data)->info, 0);
+}
+
+
+static
+int handle_msgreceivepulse(struct qnx_process_entry* entry, long data)
+{
+   struct qnx_io_receive recv_data;
+   struct qnx_channel* chnl;
+      
+   if (unlikely(copy_from_user(&recv_data, (void*)data, sizeof(struct qnx_io_receive))))
+      return -EFAULT;
+   
+   chnl = qnx_process_entry_find_channel(entry, recv_data.chid);
+   if (unlikely(!chnl))
+      return -EBADF;
+   
+   return handle_msgreceive_internal(entry, chnl, &recv_data.timeout, &recv_data.out, 1, &((struct qnx_io_receive*)data)->info, 1);
+}
+
+
+static
+int handle_msgreceivev(struct qnx_process_entry* entry, long data)
+{
+   int rc;
+   struct qnx_io_receivev io;
+   struct qnx_channel* chnl;
+   struct qnx_iovec_buf out;
+      
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_receivev))))
+      return -EFAULT;
+   
+   // scattered straight into the receiver's buffers
+   if (unlikely((rc = qnx_iovec_buf_import(&out, io.out, io.out_len))))
+      goto out;
+   
+   chnl = qnx_process_entry_find_channel(entry, io.chid);
+   if (unlikely(!chnl))
+   {
+      rc = -EBADF;
+      goto out;
+   }
+   
+   rc = handle_msgreceive_internal(entry, chnl, &io.timeout, out.iov, out.nr_segs, &((struct qnx_io_receivev*)data)->info, 0);
+   
 out:
+   qnx_iovec_buf_release(&out);
+   
+   return rc;
+}
+
 
+/// offset of the next message within the MsgReceiveBatch buffer, see MsgReceiveBatchNext
+#define QNX_BATCH_NEXT(offset, len) ALIGN((offset) + (len), 8)
+
+
+static
+int handle_msgreceive_batch(struct qnx_process_entry* entry, long data)
+{
+   int rc;
+   int num = 0;
+   int noreply = 0;
+   int empty;
+   size_t offset = 0;
+   
+   struct qnx_io_receive_batch io;
+   struct qnx_channel* chnl;
+   struct qnx_internal_msgsend* send_data;
+   struct qnx_internal_msgsend* next;
+   struct _msg_info info;
+   struct qnx_iov_iter iter;
+   struct iovec out;
+   
+   LIST_HEAD(received);
+      
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_receive_batch))))
+      return -EFAULT;
+      
+   if (unlikely(io.max <= 0))
+      return -EINVAL;
+   
+   chnl = qnx_process_entry_find_channel(entry, io.chid);
+   if (unlikely(!chnl))
+      return -EBADF;
+   
+again:
+   rc = qnx_channel_wait_for_messages(chnl, 0, qnx_timeout_remaining(&io.timeout, QNX_TIMEOUT_RECEIVE));
+   
+   if (unlikely(rc == -ERESTARTSYS))
+      goto out_channel_release;
+   
+   // submission ring entries are received from the waiting list, too
+   if (unlikely(!list_empty(&chnl->rings)))
+      qnx_channel_flush_rings(chnl);
+   
+   spin_lock(&chnl->waiting_lock);
+   
+   qnx_channel_take_incoming(chnl);
+   empty = qnx_msg_queue_empty(&chnl->waiting) && qnx_msg_queue_empty(&chnl->pulse_queue);
+   
+   while ((send_data = qnx_channel_first_message(chnl, 0)))
+   {
+      size_t len = send_data->rcvid == 0 ? sizeof(struct _pulse) : send_data->data.msg.in.iov_len;
+      
+      // messages to be replied are left to MsgReceive
+      if (send_data->task || num == io.max)
+         break;
+      
+      // only the first message may get truncated, as with MsgReceive
+      if (num > 0 && offset + len > io.out.iov_len)
+         break;
+         
+      if (send_data->rcvid > 0)
+         ++noreply;
+         
+      qnx_channel_remove_message(chnl, send_data);
+      list_add_tail(&send_data->hook, &received);
+      
+      offset = QNX_BATCH_NEXT(offset, len);
+      ++num;
+   }
+   
+   spin_unlock(&chnl->waiting_lock);
+   
+   if (empty)
+   {
+      // another receiver was faster, the deadline is checked by the next wait
+      if (rc == 0 && likely(!ACCESS_ONCE(chnl->destroyed)))
+         goto again;
+         
+      rc = -ETIMEDOUT;
+      goto out_channel_release;
+   }
+   
+   rc = num;
+   offset = 0;
+   num = 0;
+   
+   list_for_each_entry_safe(send_data, next, &received, hook)
+   {
+      size_t avail = offset < io.out.iov_len ? io.out.iov_len - offset : 0;
+      
+      memset(&info, 0, sizeof(struct _msg_info));
+      
+      info.pid = send_data->sender_pid;
+      info.chid = chnl->chid;
+      info.priority = send_data->priority;
+      
+      if (send_data->rcvid == 0)
+      {
+         struct _pulse pulse;
+         
+         memset(&pulse, 0, sizeof(struct _pulse));
+         pulse.code = send_data->data.pulse.code;
+         pulse.value.sival_int = send_data->data.pulse.value;
+         pulse.scoid = send_data->data.pulse.coid;
+         
+         info.scoid = send_data->data.pulse.coid;
+         info.coid = send_data->data.pulse.coid;
+         info.msglen = 2 * sizeof(int);
+         info.srcmsglen = 2 * sizeof(int);
+         
+         if (avail >= sizeof(struct _pulse) && copy_to_user(io.out.iov_base + offset, &pulse, sizeof(struct _pulse)))
+            rc = -EFAULT;
+            
+         offset = QNX_BATCH_NEXT(offset, sizeof(struct _pulse));
+      }
+      else
+      {
+         info.scoid = send_data->data.msg.coid;
+         info.coid = send_data->data.msg.coid;
+         info.msglen = send_data->data.msg.in.iov_len;
+         info.srcmsglen = send_data->data.msg.in.iov_len;
+         info.flags |= QNX_FLAG_NOREPLY;
+         
+         out.iov_base = io.out.iov_base + offset;
+         out.iov_len = avail;
+         
+         qnx_iov_iter_init(&iter, &out, 1, 0);
+         
+         if (qnx_internal_msgsend_read(send_data, 0, &iter, avail) < 0)
+            rc = -EFAULT;
+            
+         offset = QNX_BATCH_NEXT(offset, send_data->data.msg.in.iov_len);
+      }
+      
+      if (copy_to_user(io.infos + num, &info, sizeof(struct _msg_info)))
+         rc = -EFAULT;
+      
+      list_del(&send_data->hook);
+      qnx_internal_msgsend_free(send_data);
+      
+      ++num;
+   }
+   
+   if (noreply)
+      qnx_channel_noreply_consumed(chnl);
+   
+out_channel_release:
+
+   qnx_channel_release(chnl);
+   
    return rc;
 }
 
 
+/**
+ * @param in the reply, the array already copied from userspace
+ * @param sync set if the caller is going to block in MsgReceive afterwards
+ */
 static
-int handle_msgreply(struct qnx_process_entry* entry, struct qnx_io_reply* data)
+int handle_msgreply_internal(struct qnx_process_entry* entry, int rcvid, int status, 
+                             const struct iovec* in, unsigned long in_len, int sync)
 {
    int rc = 0;
+   size_t len = iov_length(in, in_len);
+   struct qnx_iov_iter iter;
   
-   struct qnx_internal_msgsend* send_data = qnx_process_entry_release_pending(entry, data->rcvid);
+   struct qnx_internal_msgsend* send_data = qnx_process_entry_release_pending(entry, rcvid);
    if (likely(send_data))
    {
-      if (send_data->data.msg.out.iov_base 
-         && send_data->data.msg.out.iov_len > 0 
-         && data->in.iov_len > 0)
+      // the sender waits for QNX_STATE_FINISHED, so its reply buffer stays valid
+      if (len > 0)
       {
-         send_data->reply.iov_len = 0;
-         send_data->reply.iov_base = kmalloc(data->in.iov_len, GFP_USER);      
+         qnx_iov_iter_init(&iter, in, in_len, 0);
          
-         if (likely(send_data->reply.iov_base))
-         {      
-            // copy data
-            if (likely(copy_from_user(send_data->reply.iov_base, data->in.iov_base, data->in.iov_len)) == 0)
-            {
-               send_data->reply.iov_len = data->in.iov_len;
-            }
-            else
-               rc = -EFAULT;
-         }
-         else
-            rc = -ENOMEM;
-      }
-      else
-      {         
-         send_data->reply.iov_base = 0;
-         send_data->reply.iov_len = 0;
+         if (unlikely(qnx_internal_msgsend_write_reply(send_data, &iter, len) < 0))
+            rc = -EFAULT;
       }
       
-      send_data->status = rc < 0 ? rc : data->status;
-      send_data->state = QNX_STATE_FINISHED;            
-
       // wake up the waiting process
 //      printk("wakeup ok tid=%p, data=%p, rcvid=%d\n", send_data->task, send_data, send_data->rcvid);
-      wake_up_process(send_data->task);            
+      qnx_internal_msgsend_finish(send_data, rc < 0 ? rc : status, sync);
    }
    else
       rc = -ESRCH;
@@ -432,6 +706,73 @@ int handle_msgreply(struct qnx_process_entry* entry, struct qnx_io_reply* data)
 }
 
 
+static inline
+int handle_msgreply(struct qnx_process_entry* entry, struct qnx_io_reply* data, int sync)
+{
+   return handle_msgreply_internal(entry, data->rcvid, data->status, &data->in, 1, sync);
+}
+
+
+static
+int handle_msgreplyv(struct qnx_process_entry* entry, long data)
+{
+   int rc;
+   struct qnx_io_replyv io;
+   struct qnx_iovec_buf in;
+   
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_replyv))))
+      return -EFAULT;
+   
+   // gathered straight into the sender's reply buffers
+   rc = qnx_iovec_buf_import(&in, io.in, io.in_len);
+   if (likely(rc == 0))
+      rc = handle_msgreply_internal(entry, io.rcvid, io.status, in.iov, in.nr_segs, 0);
+   
+   qnx_iovec_buf_release(&in);
+   
+   return rc;
+}
+
+
+static
+int handle_msgreplyreceive(struct qnx_process_entry* entry, long data)
+{
+   int rc;
+   int idle;
+   struct qnx_io_replyreceive io;
+   struct qnx_channel* chnl;
+   
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_replyreceive))))
+      return -EFAULT;
+   
+   chnl = qnx_process_entry_find_channel(entry, io.receive.chid);
+   if (unlikely(!chnl))
+      return -EBADF;
+   
+   // no reply on the first iteration of a server loop
+   if (io.reply.rcvid > 0)
+   {
+      // we are going to sleep, so the sender may directly run on this cpu
+      idle = atomic_read(&chnl->num_waiting) == 0 && list_empty(&chnl->rings);
+      
+      rc = handle_msgreply(entry, &io.reply, idle);
+      
+      // a restarted system call must not reply again
+      if (likely(rc == 0) && unlikely(put_user(0, &((struct qnx_io_replyreceive*)data)->reply.rcvid)))
+         rc = -EFAULT;
+         
+      if (unlikely(rc < 0))
+      {
+         qnx_channel_release(chnl);
+         return rc;
+      }
+   }
+   
+   return handle_msgreceive_internal(entry, chnl, &io.receive.timeout, &io.receive.out, 1, 
+                                     &((struct qnx_io_replyreceive*)data)->receive.info, 0);
+}
+
+
 static
 int handle_msgerror(struct qnx_process_entry* entry, struct qnx_io_error_reply* data)
 {
@@ -440,14 +781,8 @@ int handle_msgerror(struct qnx_process_entry* entry, struct qnx_io_error_reply*
    struct qnx_internal_msgsend* send_data = qnx_process_entry_release_pending(entry, data->rcvid);
    if (likely(send_data))
    {      
-      send_data->reply.iov_base = 0;
-      send_data->reply.iov_len = 0;
-
-      send_data->status = data->error < 0 ? data->error : -data->error;
-      send_data->state = QNX_STATE_FINISHED;      
-      
       // wake up the waiting process
-      wake_up_process(send_data->task);
+      qnx_internal_msgsend_finish(send_data, data->error < 0 ? data->error : -data->error, 0);
    }
    else
       rc = -ESRCH;
@@ -456,93 +791,88 @@ int handle_msgerror(struct qnx_process_entry* entry, struct qnx_io_error_reply*
 }
 
 
+/**
+ * @param out the receive buffer, the array already copied from userspace
+ */
 static
-int handle_msgread(struct qnx_process_entry* entry, struct qnx_io_read* data)
+int handle_msgread_internal(struct qnx_process_entry* entry, int rcvid, int offset, const struct iovec* out, unsigned long out_len)
 {
-   // TODO move this to process_entry instead
-   
    int rc;
    struct qnx_internal_msgsend* send_data;
+   struct qnx_iov_iter iter;
    
-   spin_lock(&entry->pending_lock);
-   
-   list_for_each_entry(send_data, &entry->pending, hook) 
+   // pinned by its readers count, so we can copy without holding any lock
+   send_data = qnx_process_entry_read_pending(entry, rcvid);
+   if (unlikely(!send_data))
+      return -ESRCH;
+      
+   if (offset >= 0 && offset <= send_data->data.msg.in.iov_len)
    {
-      if (send_data->rcvid == data->rcvid)
-      {
-         if (data->offset >= 0 && data->offset <= send_data->data.msg.in.iov_len)
-         {
-            // copy data
-            int bytes_to_copy = min(send_data->data.msg.in.iov_len - data->offset, data->out.iov_len);
-            
-            if (likely(copy_to_user(data->out.iov_base, 
-                                    send_data->data.msg.in.iov_base + data->offset, 
-                                    bytes_to_copy) == 0)) 
-            {
-               rc = bytes_to_copy;
-            }
-            else
-               rc = -EFAULT;
-         }
-         else
-            rc = -EINVAL;
-         
-         goto out;
-      }
+      qnx_iov_iter_init(&iter, out, out_len, 0);
+      rc = qnx_internal_msgsend_read(send_data, offset, &iter, iov_length(out, out_len));
    }
-
-   rc = -ESRCH;
+   else
+      rc = -EINVAL;
    
-out:
-
-   spin_unlock(&entry->pending_lock);
+   qnx_internal_msgsend_put_reader(send_data);
          
    return rc;
 }
 
 
+static inline
+int handle_msgread(struct qnx_process_entry* entry, struct qnx_io_read* data)
+{
+   return handle_msgread_internal(entry, data->rcvid, data->offset, &data->out, 1);
+}
+
+
+static
+int handle_msgreadv(struct qnx_process_entry* entry, long data)
+{
+   int rc;
+   struct qnx_io_readv io;
+   struct qnx_iovec_buf out;
+   
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_readv))))
+      return -EFAULT;
+   
+   rc = qnx_iovec_buf_import(&out, io.out, io.out_len);
+   if (likely(rc == 0))
+      rc = handle_msgread_internal(entry, io.rcvid, io.offset, out.iov, out.nr_segs);
+   
+   qnx_iovec_buf_release(&out);
+   
+   return rc;
+}
+
+
 static
 int handle_msgsend(struct qnx_process_entry* entry, long data)
 {
    int rc;
    
    struct qnx_internal_msgsend snddata;
-   struct qnx_connection conn;
    struct qnx_channel* chnl;
    
-   if (unlikely((rc = qnx_internal_msgsend_init(&snddata, (struct qnx_io_msgsend*)data, entry->pid))))         
+   if (unlikely((rc = qnx_internal_msgsend_init(&snddata, (struct qnx_io_msgsend*)data, entry->pid))))
       return rc;
 
-   conn = qnx_process_entry_find_connection(entry, snddata.data.msg.coid);              
-   if (unlikely(!QNX_CONN_IS_VALID(conn)))
-   {
-      rc = -EBADF;
-      goto out;
-   }   
-
    pr_debug("MsgSend coid=%d\n", snddata.data.msg.coid);
 
-   chnl = qnx_driver_data_find_channel(entry->driver, conn.pid, conn.chid);
+   chnl = qnx_process_entry_find_connection_channel(entry, snddata.data.msg.coid, &snddata.receiver_pid, 0);
    if (unlikely(!chnl))
    {
       rc = -EBADF;
       goto out;
    }
-         
-   snddata.receiver_pid = conn.pid;
+   
+   flush_submit_ring(entry, chnl, snddata.data.msg.coid);
             
+   // the reply is written directly into our buffer by MsgReply
    rc = handle_msgsend_internal_block(chnl, &snddata);                  
    // do not access chnl any more from here, it got released inside previous function
 
-   // copy data back to userspace - if buffer is provided
-   if (rc >= 0 && snddata.reply.iov_len > 0)
-   {
-      size_t bytes_to_copy = min(snddata.data.msg.out.iov_len, snddata.reply.iov_len);
-      
-      if (unlikely(copy_to_user(snddata.data.msg.out.iov_base, snddata.reply.iov_base, bytes_to_copy)))
-         rc = -EFAULT;
-   }               
-
 out:
        
    qnx_internal_msgsend_destroy(&snddata);
@@ -551,63 +881,115 @@ out:
 }
 
 
-/// loop until data can be sent or signal stops us from sending
+/// waits on the channel's space queue, a receiver wakes us up when a noreply slot got free
+#define wait_for_noreply_space(chnl, condition, timeout)                                          \
+({                                                                                                \
+   int __rc = wait_event_interruptible_hrtimeout((chnl)->space_queue, condition,                 \
+              (timeout) ? qnx_timeout_remaining(timeout, QNX_TIMEOUT_SEND) : ns_to_ktime(KTIME_MAX)); \
+   __rc == -ETIME ? -ETIMEDOUT : __rc;                                                            \
+})
+
+
+/**
+ * Adds the noreply message, waits for a free slot if the noreply limit of the channel 
+ * is reached unless the connection is non-blocking. snddata is freed on failure.
+ *
+ * @param timeout may be 0 for no timeout.
+ * @return 0, -EAGAIN (non-blocking), -ETIMEDOUT, -ESRCH or -ERESTARTSYS
+ */
 static 
-int busy_loop_add_new_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* snddata)
+int add_noreply_message(struct qnx_channel* chnl, struct qnx_internal_msgsend* snddata, 
+                        int flags, const struct qnx_io_timeout* timeout)
 {   
-   int rc;
+   int rc = qnx_channel_add_new_message(chnl, snddata);
+   int wait_rc;
    
-   while (unlikely((rc = qnx_channel_add_new_message(chnl, snddata)) < 0))
+   if (unlikely(rc == -EAGAIN) && !(flags & QNX_COF_NONBLOCK))
    {
-      msleep_interruptible(50);
-      
-      if (unlikely(signal_pending(current)))
-      {         
-         kfree(snddata);
-         
-         rc = -ERESTARTSYS;         
-         break;
-      }
+      wait_rc = wait_for_noreply_space(chnl, (rc = qnx_channel_add_new_message(chnl, snddata)) != -EAGAIN, timeout);
+      if (unlikely(wait_rc))
+         rc = wait_rc;
    }
    
+   if (unlikely(rc < 0))
+      qnx_internal_msgsend_free(snddata);
+   
    return rc;
 }
 
 
+/// noreply messages are taken from the channel's pool if there is one, wait for a free slot in that case
+static
+int alloc_noreply_msgsend(struct qnx_channel* chnl, struct qnx_internal_msgsend** snddata, 
+                          int flags, const struct qnx_io_timeout* timeout)
+{
+   int rc;
+   
+   if (!chnl->noreply_pool)
+   {
+      *snddata = qnx_internal_msgsend_alloc();
+      return *snddata ? 0 : -ENOMEM;
+   }
+   
+   if (likely((*snddata = qnx_msgsend_pool_get(chnl->noreply_pool)) != 0))
+      return 0;
+      
+   if (flags & QNX_COF_NONBLOCK)
+      return -EAGAIN;
+   
+   rc = wait_for_noreply_space(chnl, (*snddata = qnx_msgsend_pool_get(chnl->noreply_pool)) != 0 
+                                     || ACCESS_ONCE(chnl->destroyed), timeout);
+   
+   if (likely(*snddata))
+      return 0;
+   
+   return rc ? rc : -ESRCH;
+}
+
+
 static
 int handle_msgsend_no_reply(struct qnx_process_entry* entry, long data)
 {
-   struct qnx_internal_msgsend* snddata = 0;
-   struct qnx_connection conn;
+   struct qnx_internal_msgsend* snddata;
    struct qnx_channel* chnl;
+   struct qnx_io_timeout timeout;
+   pid_t pid;
+   int flags;
+   int coid;
    int rc;
    
-   if (unlikely((rc = qnx_internal_msgsend_init_noreply(&snddata, (struct qnx_io_msgsend*)data, entry->pid))))         
-      return rc;
-
-   // TODO move this code directly into qnx_process_entry, we are not 
-   // interested in the connection, just in the channel...
-   if (unlikely(!QNX_CONN_IS_VALID((conn = qnx_process_entry_find_connection(entry, snddata->data.msg.coid)))))
-   {
-      kfree(snddata);
-      return -EBADF;
-   }   
+   // we need the channel before the message since it decides where the message is stored
+   if (unlikely(get_user(coid, (int*)data)
+      || copy_from_user(&timeout, &((struct qnx_io_msgsend*)data)->timeout, sizeof(struct qnx_io_timeout))))
+      return -EFAULT;
 
-   pr_debug("MsgSendNoReply coid=%d\n", snddata->data.msg.coid);
+   pr_debug("MsgSendNoReply coid=%d\n", coid);
 
-   if (unlikely(!(chnl = qnx_driver_data_find_channel(entry->driver, conn.pid, conn.chid))))
+   if (unlikely(!(chnl = qnx_process_entry_find_connection_channel(entry, coid, &pid, &flags))))
+      return -EBADF;
+      
+   rc = alloc_noreply_msgsend(chnl, &snddata, flags, &timeout);
+   if (unlikely(rc))
+      goto out;
+   
+   rc = qnx_internal_msgsend_init_noreply(snddata, (struct qnx_io_msgsend*)data, entry->pid);
+   if (unlikely(rc))
    {
-      kfree(snddata);
-      return -EBADF;
+      qnx_internal_msgsend_free(snddata);
+      goto out;
    }
          
-   snddata->receiver_pid = conn.pid;
+   snddata->receiver_pid = pid;
+   
+   flush_submit_ring(entry, chnl, coid);
             
-   rc = busy_loop_add_new_message(chnl, snddata); 
+   rc = add_noreply_message(chnl, snddata, flags, &timeout); 
    
+out:
+
    qnx_channel_release(chnl);
    
-   return 0;
+   return rc;
 }
 
 
@@ -617,93 +999,53 @@ int handle_msgsendv(struct qnx_process_entry* entry, long data)
    int rc;
    
    struct qnx_io_msgsendv send_data = { 0 };
-   struct qnx_connection conn;
    struct qnx_channel* chnl;
    struct qnx_internal_msgsend snddata;
    
-   struct iovec buf_in[QNX_MAX_IOVEC_LEN];
-   struct iovec buf_out[QNX_MAX_IOVEC_LEN];
-
-   struct iovec* in = buf_in;
-   struct iovec* out = buf_out;
+   struct qnx_iovec_buf in;
+   struct qnx_iovec_buf out;
 
    if (copy_from_user(&send_data, (void*)data, sizeof(struct qnx_io_msgsendv)))
-   {
-      rc = -EFAULT;
-      goto out; 
-   }
+      return -EFAULT;
    
-   if (unlikely(send_data.in_len > QNX_MAX_IOVEC_LEN))
-   {            
-      if (unlikely(!(in = (struct iovec*)kmalloc(sizeof(struct iovec) * send_data.in_len, GFP_USER))))
-      {
-         rc = -ENOMEM;
-         goto out;
-      }
-   }         
-
-   if (unlikely(send_data.out_len > QNX_MAX_IOVEC_LEN))
-   {
-      if (unlikely(!(out = (struct iovec*)kmalloc(sizeof(struct iovec) * send_data.out_len, GFP_USER))))
-      {         
-         rc = -ENOMEM;
-         goto out_clean_in;
-      }
-   }
-                                      
-   if (unlikely(copy_from_user(in, send_data.in, sizeof(struct iovec) * send_data.in_len)
-      || copy_from_user(out, send_data.out, sizeof(struct iovec) * send_data.out_len)))                  
-   {
-      rc = -EFAULT;
+   if (unlikely((rc = qnx_iovec_buf_import(&in, send_data.in, send_data.in_len))))
+      goto out_clean_in;
+   
+   if (unlikely((rc = qnx_iovec_buf_import(&out, send_data.out, send_data.out_len))))
       goto out_clean_out;
-   }
    
    // replace the pointers...
-   send_data.in = in;
-   send_data.out = out;
+   send_data.in = in.iov;
+   send_data.out = out.iov;
 
-   conn = qnx_process_entry_find_connection(entry, send_data.coid);
-   if (unlikely(!QNX_CONN_IS_VALID(conn)))
-   {
-      rc = -EBADF;
-      goto out_clean_out;
-   }
+   if (unlikely((rc = qnx_internal_msgsend_initv(&snddata, &send_data, entry->pid))))
+      goto out_clean_out;  
 
-   chnl = qnx_driver_data_find_channel(entry->driver, conn.pid, conn.chid);
+   chnl = qnx_process_entry_find_connection_channel(entry, send_data.coid, &snddata.receiver_pid, 0);
    if (unlikely(!chnl))
    {
       rc = -EBADF;
-      goto out_clean_out;
+      goto out_destroy;
    }    
    
-   if (unlikely((rc = qnx_internal_msgsend_initv(&snddata, &send_data, entry->pid))))
-      goto out_clean_out;  
-
-   snddata.receiver_pid = conn.pid; 
+   flush_submit_ring(entry, chnl, send_data.coid);
    
+   // the reply is written directly into our iovec by MsgReply
    rc = handle_msgsend_internal_block(chnl, &snddata);                                    
    // do not access chnl any more from here
 
-   // copy data back to userspace - if buffer is provided
-   if (rc >= 0 && snddata.reply.iov_len > 0)
-   {
-      size_t bytes_to_copy = min(snddata.data.msg.out.iov_len, snddata.reply.iov_len);   
-
-      if (memcpy_toiovec(out, snddata.reply.iov_base, bytes_to_copy))
-         rc = -EFAULT;
-   }
+out_destroy:
 
-   qnx_internal_msgsend_destroyv(&snddata);
+   qnx_internal_msgsend_destroy(&snddata);
       
 out_clean_out:
 
-   QNX_FREE_IF_NOT(out, buf_out);
+   qnx_iovec_buf_release(&out);
    
 out_clean_in:    
 
-   QNX_FREE_IF_NOT(in, buf_in);
-      
-out:    
+   qnx_iovec_buf_release(&in);
+   
    return rc;
 }
 
@@ -714,67 +1056,371 @@ int handle_msgsend_noreplyv(struct qnx_process_entry* entry, long data)
    int rc;
    
    struct qnx_io_msgsendv send_data = { 0 };
-   struct qnx_connection conn;
    struct qnx_channel* chnl;
    struct qnx_internal_msgsend* snddata = 0;
+   pid_t pid;
+   int flags;
    
-   struct iovec buf_in[QNX_MAX_IOVEC_LEN];   
-
-   struct iovec* in = buf_in;
+   struct qnx_iovec_buf in;
 
    if (copy_from_user(&send_data, (void*)data, sizeof(struct qnx_io_msgsendv)))
-   {
-      rc = -EFAULT;
-      goto out; 
-   }
+      return -EFAULT;
       
-   if (unlikely(send_data.in_len > QNX_MAX_IOVEC_LEN))
-   {            
-      if (unlikely(!(in = (struct iovec*)kmalloc(sizeof(struct iovec) * send_data.in_len, GFP_USER))))
-      {
-         rc = -ENOMEM;
-         goto out;
-      }
-   }            
-                                      
-   if (unlikely(copy_from_user(in, send_data.in, sizeof(struct iovec) * send_data.in_len)))                  
-   {
-      rc = -EFAULT;
+   if (unlikely((rc = qnx_iovec_buf_import(&in, send_data.in, send_data.in_len))))
       goto out_clean;
-   }
    
    // replace the pointers...
-   send_data.in = in;   
-
-   conn = qnx_process_entry_find_connection(entry, send_data.coid);
-   if (unlikely(!QNX_CONN_IS_VALID(conn)))
-   {
-      rc = -EBADF;
-      goto out_clean;
-   }
+   send_data.in = in.iov;   
 
-   chnl = qnx_driver_data_find_channel(entry->driver, conn.pid, conn.chid);
+   chnl = qnx_process_entry_find_connection_channel(entry, send_data.coid, &pid, &flags);
    if (unlikely(!chnl))
    {
       rc = -EBADF;
       goto out_clean;
    }    
    
-   if (unlikely((rc = qnx_internal_msgsend_init_noreplyv(&snddata, &send_data, entry->pid))))
-      goto out_clean;  
+   if (unlikely((rc = alloc_noreply_msgsend(chnl, &snddata, flags, &send_data.timeout))))
+      goto out_release;
+   
+   if (unlikely((rc = qnx_internal_msgsend_init_noreplyv(snddata, &send_data, entry->pid))))
+   {
+      qnx_internal_msgsend_free(snddata);
+      goto out_release;  
+   }
 
-   snddata->receiver_pid = conn.pid;   
+   snddata->receiver_pid = pid;   
+   
+   flush_submit_ring(entry, chnl, send_data.coid);
    
-   rc = busy_loop_add_new_message(chnl, snddata);   
+   rc = add_noreply_message(chnl, snddata, flags, &send_data.timeout);   
       
+out_release:
+
    // FIXME do we need this if we use RCU for channels?
    qnx_channel_release(chnl);
          
 out_clean:    
 
-   QNX_FREE_IF_NOT(in, buf_in);
+   qnx_iovec_buf_release(&in);
+   
+   return rc;
+}
+
+
+/**
+ * Moves a group of messages to the channel, waits as long as the noreply limit is 
+ * reached unless the connection is non-blocking.
+ *
+ * @param err set to the reason if not all messages could be added.
+ * @return the number of messages added
+ */
+static
+int add_message_group(struct qnx_channel* chnl, struct list_head* group, int flags, 
+                      const struct qnx_io_timeout* timeout, int* err)
+{
+   int rc = 0;
+   int added;
+   struct qnx_internal_msgsend* data;
+   struct qnx_internal_msgsend* next;
+   
+   for(;;)
+   {
+      added = qnx_channel_add_new_messages(chnl, group);
+      if (unlikely(added < 0))
+      {
+         *err = added;
+         break;
+      }
+         
+      rc += added;
+      
+      if (likely(list_empty(group)))
+         break;
+      
+      if (flags & QNX_COF_NONBLOCK)
+      {
+         *err = -EAGAIN;
+         break;
+      }
+         
+      // the next round reports a destroyed channel
+      if (unlikely((*err = wait_for_noreply_space(chnl, 
+            atomic_read(&chnl->num_waiting_noreply) < (int)qnx_max_noreply_msg_num || ACCESS_ONCE(chnl->destroyed), timeout))))
+         break;
+   }
+   
+   // the channel is gone, we got a signal or must not block
+   list_for_each_entry_safe(data, next, group, hook)
+   {
+      list_del(&data->hook);
+      qnx_internal_msgsend_free(data);
+   }
+   
+   return rc;
+}
+
+
+/**
+ * Entries are processed in chunks. All entries of a chunk going to the 
+ * same channel are added with one lookup, one lock and one wakeup. 
+ * Processing stops at the first failing entry, the entries before
+ * are sent. A chunk is cut short if an entry has to wait for noreply
+ * pool space, since the entries before may hold the missing descriptors.
+ */
+static
+int handle_msgsend_batch(struct qnx_process_entry* entry, long data)
+{
+   int rc = 0;
+   int sent = 0;
+   int done = 0;
+   int i, j;
+   
+   struct qnx_io_msgsend_batch io;
+   size_t entry_size;
+   
+   union
+   {
+      struct _pulse_batch pulses[QNX_BATCH_CHUNK];
+      struct _noreply_batch msgs[QNX_BATCH_CHUNK];
+   } buf;
+   
+   struct qnx_internal_msgsend* snddata[QNX_BATCH_CHUNK];
+   struct qnx_channel* chnls[QNX_BATCH_CHUNK];      ///< target channel for each entry
+   struct qnx_channel* distinct[QNX_BATCH_CHUNK];   ///< each channel once, holds the reference
+   int distinct_flags[QNX_BATCH_CHUNK];             ///< QNX_COF_NONBLOCK if any connection to the channel has it
+   
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_msgsend_batch))))
+      return -EFAULT;
+      
+   if (io.type == QNX_BATCH_PULSE)
+   {
+      entry_size = sizeof(struct _pulse_batch);
+   }
+   else if (io.type == QNX_BATCH_NOREPLY)
+   {
+      entry_size = sizeof(struct _noreply_batch);
+   }
+   else
+      return -EINVAL;
+   
+   while (done < io.num && rc == 0)
+   {
+      int num = min(io.num - done, QNX_BATCH_CHUNK);
+      int num_distinct = 0;
+      int prepared;
+      int err = -ESRCH;
+      
+      if (unlikely(copy_from_user(&buf, io.entries + done * entry_size, num * entry_size)))
+      {
+         rc = -EFAULT;
+         break;
+      }
+      
+      // pulses are taken from the pulse pool of the target channel
+      if (io.type == QNX_BATCH_PULSE)
+      {
+         memset(snddata, 0, sizeof(snddata));
+      }
+      else if (unlikely((rc = qnx_internal_msgsend_alloc_bulk(snddata, num))))
+         break;
+      
+      for (prepared=0; prepared<num; ++prepared)
+      {
+         struct qnx_channel* chnl;
+         pid_t pid;
+         int flags;
+         int coid = (io.type == QNX_BATCH_PULSE ? buf.pulses[prepared].coid : buf.msgs[prepared].coid) & ~QNX_SIDE_CHANNEL;
+         
+         chnl = qnx_process_entry_find_connection_channel(entry, coid, &pid, &flags);
+         if (unlikely(!chnl))
+         {
+            rc = -EBADF;
+            break;
+         }
+         
+         for (j=0; j<num_distinct && distinct[j] != chnl; ++j);
+         
+         // keep one reference per distinct channel
+         if (j == num_distinct)
+         {
+            distinct[j] = chnl;
+            distinct_flags[j] = 0;
+            ++num_distinct;
+         }
+         else
+            qnx_channel_release(chnl);
+         
+         distinct_flags[j] |= flags & QNX_COF_NONBLOCK;
+         
+         chnls[prepared] = distinct[j];
+         
+         if (io.type == QNX_BATCH_PULSE)
+         {
+            if (unlikely((rc = qnx_pulse_pool_get(&chnls[prepared]->pulses, &snddata[prepared]))))
+               break;
+               
+            qnx_internal_msgsend_init_pulse_batch(snddata[prepared], &buf.pulses[prepared], entry->pid);
+            snddata[prepared]->data.pulse.coid = coid;
+         }
+         else
+         {
+            if (chnls[prepared]->noreply_pool)
+            {
+               qnx_internal_msgsend_free(snddata[prepared]);
+               
+               // send the prepared entries first, this one starts the next chunk
+               snddata[prepared] = qnx_msgsend_pool_get(chnls[prepared]->noreply_pool);
+               if (unlikely(!snddata[prepared]) && prepared > 0)
+                  break;
+               
+               if (unlikely(!snddata[prepared]) 
+                  && unlikely((rc = alloc_noreply_msgsend(chnls[prepared], &snddata[prepared], flags, &io.timeout))))
+               {
+                  // keep the array intact for the clean-up below
+                  snddata[prepared] = 0;
+                  break;
+               }
+            }
+            
+            if (unlikely((rc = qnx_internal_msgsend_init_noreply_batch(snddata[prepared], &buf.msgs[prepared], entry->pid))))
+               break;
+               
+            snddata[prepared]->data.msg.coid = coid;
+         }
+         
+         snddata[prepared]->receiver_pid = pid;
+         
+         flush_submit_ring(entry, chnls[prepared], coid);
+      }
+      
+      // free the failed and the unused descriptors
+      for (i=prepared; i<num; ++i)
+      {
+         if (snddata[i])
+            qnx_internal_msgsend_free(snddata[i]);
+      }
+      
+      // one lock and wakeup per channel, order within a channel is kept
+      for (j=0; j<num_distinct; ++j)
+      {
+         LIST_HEAD(group);
+         
+         for (i=0; i<prepared; ++i)
+         {
+            if (chnls[i] == distinct[j])
+               list_add_tail(&snddata[i]->hook, &group);
+         }
+         
+         sent += add_message_group(distinct[j], &group, distinct_flags[j], &io.timeout, &err);
+         
+         qnx_channel_release(distinct[j]);
+      }
+      
+      if (unlikely(sent < done + prepared))
+         rc = err;
+      
+      done += prepared;
+   }
+   
+   return sent > 0 ? sent : rc;
+}
+
+
+static
+int handle_noreply_notify(struct qnx_process_entry* entry, long data)
+{
+   int rc;
+   
+   struct qnx_io_noreply_notify io;
+   struct _pulse_batch pulse;
+   struct qnx_noreply_notify* notify;
+   struct qnx_channel* chnl;
+   pid_t pid;
+   
+   if (unlikely(copy_from_user(&io, (void*)data, sizeof(struct qnx_io_noreply_notify))))
+      return -EFAULT;
+   
+   io.coid &= ~QNX_SIDE_CHANNEL;
+   io.notify_coid &= ~QNX_SIDE_CHANNEL;
+   
+   if (unlikely(!(notify = kmalloc(sizeof(struct qnx_noreply_notify), GFP_KERNEL))))
+      return -ENOMEM;
+   
+   if (unlikely(!(notify->pulse = qnx_internal_msgsend_alloc())))
+   {
+      rc = -ENOMEM;
+      goto out_free;
+   }
+   
+   notify->chnl = qnx_process_entry_find_connection_channel(entry, io.notify_coid, &pid, 0);
+   if (unlikely(!notify->chnl))
+   {
+      rc = -EBADF;
+      goto out_free_pulse;
+   }
+   
+   chnl = qnx_process_entry_find_connection_channel(entry, io.coid, 0, 0);
+   if (unlikely(!chnl))
+   {
+      rc = -EBADF;
+      goto out_release;
+   }
+   
+   pulse.coid = io.notify_coid;
+   pulse.priority = -1;   // the registering thread's priority
+   pulse.code = io.code;
+   pulse.value = io.value;
+   
+   qnx_internal_msgsend_init_pulse_batch(notify->pulse, &pulse, entry->pid);
+   notify->pulse->receiver_pid = pid;
+   
+   // the notification owns the pulse and the reference to its target from here
+   rc = qnx_channel_add_noreply_notify(chnl, notify);
+   qnx_channel_release(chnl);
+   
+   if (likely(rc == 0))
+      return 0;
+      
+out_release:
+
+   qnx_channel_release(notify->chnl);
+   
+out_free_pulse:
+
+   qnx_internal_msgsend_free(notify->pulse);
+   
+out_free:
+
+   kfree(notify);
+   
+   return rc;
+}
+
+
+static
+int handle_ring_doorbell(struct qnx_process_entry* entry, int coid)
+{
+   int rc = -EBADF;
+   
+   struct qnx_channel* chnl;
+   struct qnx_submit_ring* ring = qnx_process_entry_find_ring(entry, coid);
+   
+   if (unlikely(!ring))
+      return -EBADF;
+      
+   ACCESS_ONCE(ring->hdr->need_wakeup) = 0;
+   
+   chnl = qnx_process_entry_find_connection_channel(entry, coid, 0, 0);
+   if (likely(chnl))
+   {
+      qnx_channel_wake_receivers(chnl, entry->pid, coid, 1, 1, 0);
+      qnx_channel_release(chnl);
+      
+      rc = 0;
+   }
+   
+   qnx_submit_ring_release(ring);
    
-out:    
    return rc;
 }
 
@@ -785,6 +1431,7 @@ out:
 static
 int qnxcomm_open(struct inode* n, struct file* f)
 {
+   int rc;
    struct qnx_process_entry* entry;
    
    if (f->f_mode & O_RDWR)
@@ -798,7 +1445,12 @@ int qnxcomm_open(struct inode* n, struct file* f)
       if (unlikely(!entry))
          return -ENOMEM;
             
-      qnx_process_entry_init(entry, &driver_data);
+      rc = qnx_process_entry_init(entry, &driver_data);
+      if (unlikely(rc))
+      {
+         kfree(entry);
+         return rc;
+      }
 
       f->private_data = entry;
       qnx_driver_data_add_process(&driver_data, entry);      
@@ -862,7 +1514,7 @@ unsigned int qnxcomm_poll(struct file* f, struct poll_table_struct* ptable)
    {
       poll_wait(f, &chnl->waiting_queue,  ptable);
       
-      if (atomic_read(&chnl->num_waiting) > 0)
+      if (qnx_channel_has_messages(chnl))
          mask |= POLLIN | POLLRDNORM;
    }
    else
@@ -872,6 +1524,39 @@ unsigned int qnxcomm_poll(struct file* f, struct poll_table_struct* ptable)
 }
 
 
+/// maps the submission ring of the connection given by the page offset
+static
+int qnxcomm_mmap(struct file* f, struct vm_area_struct* vma)
+{
+   int rc;
+   struct qnx_submit_ring* ring;
+   
+   if (unlikely(!f->private_data))
+      return -ENOTTY;
+      
+   if (unlikely(current_get_pid_nr(current) != QNX_PROC_ENTRY(f)->pid))
+      return -ENOSPC;
+      
+   if (unlikely(vma->vm_end - vma->vm_start != PAGE_ALIGN(sizeof(struct qnx_ring_header)) || vma->vm_pgoff > INT_MAX))
+      return -EINVAL;
+      
+   ring = qnx_process_entry_add_ring(QNX_PROC_ENTRY(f), vma->vm_pgoff, &rc);
+   if (unlikely(!ring))
+      return rc;
+      
+   // a forked child must not send with our pid
+   qnx_vm_flags_set(vma, VM_DONTCOPY | VM_DONTEXPAND);
+   
+   rc = remap_vmalloc_range(vma, ring->hdr, 0);
+   if (unlikely(rc))
+      qnx_process_entry_remove_ring(QNX_PROC_ENTRY(f), ring->coid);
+      
+   qnx_submit_ring_release(ring);
+   
+   return rc;
+}
+
+
 static 
 long qnxcomm_ioctl(struct file* f, unsigned int cmd, unsigned long data)
 {      
@@ -891,8 +1576,17 @@ long qnxcomm_ioctl(struct file* f, unsigned int cmd, unsigned long data)
    switch(cmd)
    {
    case QNX_IO_CHANNELCREATE:      
-      rc = qnx_process_entry_add_channel(QNX_PROC_ENTRY(f));
-      pr_info("ChannelCreate chid=%d\n", rc);      
+      {
+         struct qnx_io_channelcreate create_data = { 0 };
+         
+         if (likely(copy_from_user(&create_data, (void*)data, sizeof(struct qnx_io_channelcreate)) == 0))
+         {
+            rc = qnx_process_entry_add_channel(QNX_PROC_ENTRY(f), create_data.flags);
+            pr_info("ChannelCreate chid=%d\n", rc);      
+         }
+         else
+            rc = -EFAULT;
+      }
       break;
    
    case QNX_IO_CHANNELDESTROY:
@@ -934,6 +1628,26 @@ long qnxcomm_ioctl(struct file* f, unsigned int cmd, unsigned long data)
    case QNX_IO_MSGRECEIVE:      
       rc = handle_msgreceive(QNX_PROC_ENTRY(f), data);
       break;
+      
+   case QNX_IO_MSGRECEIVE_BATCH:      
+      rc = handle_msgreceive_batch(QNX_PROC_ENTRY(f), data);
+      break;
+      
+   case QNX_IO_MSGRECEIVEPULSE:      
+      rc = handle_msgreceivepulse(QNX_PROC_ENTRY(f), data);
+      break;
+      
+   case QNX_IO_MSGRECEIVEV:      
+      rc = handle_msgreceivev(QNX_PROC_ENTRY(f), data);
+      break;
+      
+   case QNX_IO_MSGREPLYV:      
+      rc = handle_msgreplyv(QNX_PROC_ENTRY(f), data);
+      break;
+      
+   case QNX_IO_MSGREADV:      
+      rc = handle_msgreadv(QNX_PROC_ENTRY(f), data);
+      break;
    
    case QNX_IO_MSGREPLY:      
       {
@@ -941,13 +1655,17 @@ long qnxcomm_ioctl(struct file* f, unsigned int cmd, unsigned long data)
       
          if (likely(copy_from_user(&reply_data, (void*)data, sizeof(struct qnx_io_reply)) == 0))
          {              
-            rc = handle_msgreply(QNX_PROC_ENTRY(f), &reply_data);
+            rc = handle_msgreply(QNX_PROC_ENTRY(f), &reply_data, 0);
          }
          else
             rc = -EFAULT;
       }      
       break;
       
+   case QNX_IO_MSGREPLYRECEIVE:
+      rc = handle_msgreplyreceive(QNX_PROC_ENTRY(f), data);
+      break;
+      
    case QNX_IO_MSGERROR:      
       {
          struct qnx_io_error_reply reply_data = { 0 };
@@ -986,6 +1704,18 @@ long qnxcomm_ioctl(struct file* f, unsigned int cmd, unsigned long data)
       rc = qnx_process_entry_add_pollfd(QNX_PROC_ENTRY(f), f, data);
       break;
       
+   case QNX_IO_RING_DOORBELL:
+      rc = handle_ring_doorbell(QNX_PROC_ENTRY(f), data);
+      break;
+      
+   case QNX_IO_MSGSEND_BATCH:
+      rc = handle_msgsend_batch(QNX_PROC_ENTRY(f), data);
+      break;
+      
+   case QNX_IO_NOREPLY_NOTIFY:
+      rc = handle_noreply_notify(QNX_PROC_ENTRY(f), data);
+      break;
+      
    default:
       rc = -EINVAL;
       break;
@@ -1001,6 +1731,7 @@ struct file_operations fops = {
    .unlocked_ioctl = &qnxcomm_ioctl,
    .compat_ioctl = &qnxcomm_ioctl,
    .poll = &qnxcomm_poll,
+   .mmap = &qnxcomm_mmap,
    .release = &qnxcomm_close
 };
 
@@ -1008,8 +1739,11 @@ struct file_operations fops = {
 static
 int __init qnxcomm_init(void)
 {
+   if (qnx_internal_msgsend_cache_init())
+      return -ENOMEM;
+      
    if (alloc_chrdev_region(&dev_number, 0, 1, "QnxComm") <0)
-      return -EIO;
+      goto free_cache;
         
    instance = cdev_alloc();
    if (!instance)
@@ -1042,6 +1776,9 @@ free_cdev:
 
 free_region:
    unregister_chrdev_region(dev_number, 1);
+   
+free_cache:
+   qnx_internal_msgsend_cache_destroy();
    return -EIO;
 }
 
@@ -1059,6 +1796,9 @@ void __exit qnxcomm_cleanup(void)
    class_destroy(the_class);
    cdev_del(instance);
    unregister_chrdev_region(dev_number, 1);
+   
+   qnx_driver_data_destroy(&driver_data);
+   qnx_internal_msgsend_cache_destroy();
 }
 
 
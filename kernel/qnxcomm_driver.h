@@ -24,6 +24,28 @@
 #define QNX_FLAG_NOREPLY    0x1
 
 
+/// ChannelCreate flag: preallocate noreply_per_channel x noreply_max_size bytes for MsgSendNoReply(v)
+#define QNX_CHF_NOREPLY_POOL   0x00010000
+
+/// ChannelCreate flag: a receiving thread runs at the priority of its client until it replied
+#define QNX_CHF_PRIO_INHERIT   0x00020000
+
+/// ChannelCreate flag: an idle receiving thread is woken up last in, first out (cache-hot first)
+#define QNX_CHF_WAKE_LIFO      0x00040000
+
+/// ChannelCreate flag: prefer waking up the thread which served the sending connection last
+#define QNX_CHF_WAKE_STICKY    0x00080000
+
+/// ChannelCreate flag: a pulse is merged into a queued one of the same connection, code and priority
+#define QNX_CHF_COALESCE_PULSES   0x00100000
+
+/// ConnectAttach flag: small noreply messages and pulses are sent through a submission ring
+#define QNX_COF_SUBMIT_RING    0x00010000
+
+/// ConnectAttach flag: noreply messages fail with EAGAIN instead of blocking if the channel is full
+#define QNX_COF_NONBLOCK       0x00020000
+
+
 struct _msg_info 
 {
    uint32_t  nd;         ///< client node address, always 0    
@@ -52,6 +74,23 @@ struct _pulse
 };
 
 
+struct _pulse_batch
+{
+   int coid;
+   int priority;
+   int code;
+   int value;
+};
+
+
+struct _noreply_batch
+{
+   int coid;
+   const void* smsg;
+   int sbytes;
+};
+
+
 #endif   // __QNXCOMM_H
 
 
@@ -69,20 +108,37 @@ struct qnx_io_attach
 };
 
 
+/// TimerTimeout flags, i.e. the blocking states a deadline applies to
+#define QNX_TIMEOUT_SEND      0x10
+#define QNX_TIMEOUT_RECEIVE   0x20
+#define QNX_TIMEOUT_REPLY     0x40
+
+
+struct qnx_io_timeout
+{
+   uint64_t deadline;   ///< absolute CLOCK_MONOTONIC time in nanoseconds
+   int flags;           ///< QNX_TIMEOUT_xxx, 0 if there is no deadline
+};
+
+
 struct qnx_io_msgsend
 {
    int coid;
-   int timeout_ms;    ///< timeout in milliseconds
+   struct qnx_io_timeout timeout;
       
    struct iovec in;
    struct iovec out;
 };
 
 
+/// messages up to this size fit into a submission ring slot and the message descriptor
+#define QNX_SMALL_MSG_SIZE 128
+
+
 struct qnx_io_msgsendv
 {
    int coid;
-   int timeout_ms;    ///< timeout in milliseconds
+   struct qnx_io_timeout timeout;
    
    struct iovec* in;
    int in_len;
@@ -96,16 +152,42 @@ struct qnx_io_msgsendv
 struct qnx_io_msgsendpulse
 {
    int coid;
+   int priority;   ///< negative for the sender's priority
    
    int code;
    int value;   
 };
 
 
+#define QNX_BATCH_PULSE    0
+#define QNX_BATCH_NOREPLY  1
+
+
+struct qnx_io_msgsend_batch
+{
+   int type;               ///< QNX_BATCH_PULSE or QNX_BATCH_NOREPLY
+   int num;
+   struct qnx_io_timeout timeout;   ///< noreply messages only, for the wait for space
+   
+   const void* entries;    ///< array of struct _pulse_batch or struct _noreply_batch
+};
+
+
+/// sends the pulse to notify_coid once the noreply queue behind coid drains below the low watermark
+struct qnx_io_noreply_notify
+{
+   int coid;
+   
+   int notify_coid;
+   int code;
+   int value;
+};
+
+
 struct qnx_io_receive
 {
    int chid;
-   int timeout_ms;     // timeout in milliseconds
+   struct qnx_io_timeout timeout;
    
    struct iovec out;
    
@@ -113,6 +195,35 @@ struct qnx_io_receive
 };
 
 
+/// vectored MsgReceive, the message is scattered over the iovec
+struct qnx_io_receivev
+{
+   int chid;
+   struct qnx_io_timeout timeout;
+   
+   struct iovec* out;
+   int out_len;
+   
+   struct _msg_info info;
+};
+
+
+/**
+ * Messages are stored one after another, each starting at an 8 byte
+ * aligned offset. Pulses take sizeof(struct _pulse) bytes.
+ */
+struct qnx_io_receive_batch
+{
+   int chid;
+   struct qnx_io_timeout timeout;
+   
+   struct iovec out;
+   
+   struct _msg_info* infos;
+   int max;            ///< number of elements in infos
+};
+
+
 struct qnx_io_reply
 {
    int rcvid;
@@ -122,6 +233,24 @@ struct qnx_io_reply
 };
 
 
+struct qnx_io_replyv
+{
+   int rcvid;
+   int status;
+   
+   struct iovec* in;
+   int in_len;
+};
+
+
+/// MsgReply followed by MsgReceive, the reply is skipped if rcvid <= 0
+struct qnx_io_replyreceive
+{
+   struct qnx_io_reply reply;
+   struct qnx_io_receive receive;
+};
+
+
 struct qnx_io_error_reply
 {
     int rcvid;
@@ -138,6 +267,57 @@ struct qnx_io_read
 };
 
 
+struct qnx_io_readv
+{
+    int rcvid;
+    int offset;
+    
+    struct iovec* out;
+    int out_len;
+};
+
+
+/**
+ * Submission ring shared between a sending process and the kernel, one
+ * per connection. It is setup by mmap'ing sizeof(struct qnx_ring_header)
+ * bytes of the qnxcomm device at offset coid * pagesize.
+ * 
+ * The sender fills the slot at tail and then increments tail. The kernel 
+ * consumes slots within MsgReceive and increments head. If need_wakeup is 
+ * set after publishing a slot, the receiver is sleeping and the sender has
+ * to call QNX_IO_RING_DOORBELL.
+ */
+#define QNX_RING_SLOTS        64   ///< must be a power of 2
+
+#define QNX_RING_PULSE        0
+#define QNX_RING_NOREPLY      1
+
+
+struct qnx_ring_slot
+{
+   int32_t type;      ///< QNX_RING_PULSE or QNX_RING_NOREPLY
+   int32_t code;      ///< pulse code
+   int32_t value;     ///< pulse value
+   int32_t len;       ///< noreply message length
+   int32_t priority;  ///< the kernel can't tell the sender's priority here, negative values mean 0
+   
+   char data[QNX_SMALL_MSG_SIZE];
+};
+
+
+struct qnx_ring_header
+{
+   uint32_t head;           ///< written by the kernel only
+   uint32_t pad0[15];
+   
+   uint32_t tail;           ///< written by the sender only
+   uint32_t need_wakeup;    ///< set by the kernel before the receiver goes to sleep
+   uint32_t pad1[14];
+   
+   struct qnx_ring_slot slots[QNX_RING_SLOTS];
+};
+
+
 #define QNXCOMM_MAGIC 'q'
 
 
@@ -161,5 +341,23 @@ struct qnx_io_read
 #define QNX_IO_MSGSENDNOREPLY  _IOW(QNXCOMM_MAGIC, 13, struct qnx_io_msgsend)
 #define QNX_IO_MSGSENDNOREPLYV _IOW(QNXCOMM_MAGIC, 14, struct qnx_io_msgsendv)
 
+// 15 and 16 are unused
+
+#define QNX_IO_RING_DOORBELL   _IOW(QNXCOMM_MAGIC, 17, int)
+
+#define QNX_IO_MSGSEND_BATCH   _IOW(QNXCOMM_MAGIC, 18, struct qnx_io_msgsend_batch)
+
+#define QNX_IO_MSGRECEIVE_BATCH _IOW(QNXCOMM_MAGIC, 19, struct qnx_io_receive_batch)
+
+#define QNX_IO_MSGREPLYRECEIVE _IOWR(QNXCOMM_MAGIC, 20, struct qnx_io_replyreceive)
+
+#define QNX_IO_NOREPLY_NOTIFY  _IOW(QNXCOMM_MAGIC, 21, struct qnx_io_noreply_notify)
+
+#define QNX_IO_MSGRECEIVEPULSE _IOWR(QNXCOMM_MAGIC, 22, struct qnx_io_receive)
+
+#define QNX_IO_MSGRECEIVEV    _IOWR(QNXCOMM_MAGIC, 23, struct qnx_io_receivev)
+#define QNX_IO_MSGREPLYV       _IOW(QNXCOMM_MAGIC, 24, struct qnx_io_replyv)
+#define QNX_IO_MSGREADV        _IOW(QNXCOMM_MAGIC, 25, struct qnx_io_readv)
+
 
 #endif   // __QNXCOMM_DRIVER_H
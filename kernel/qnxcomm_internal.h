@@ -5,6 +5,7 @@
 #include <linux/sched.h>
 #include <linux/list.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 
 #include "qnxcomm_driver.h"
 #include "compatibility.h"
@@ -20,13 +21,39 @@
 #endif
 
 
-#define QNX_MAX_IOVEC_LEN     5
+/// batch entries copied to the kernel stack at once
+#define QNX_BATCH_CHUNK       16
+
+/// same as _NTO_SIDE_CHANNEL in userspace, the library usually strips it
+#define QNX_SIDE_CHANNEL      0x40000000
 
 
 extern int qnx_max_connections_per_process;
 extern int qnx_max_channels_per_process;
 extern uint qnx_max_noreply_msg_size;
 extern uint qnx_max_noreply_msg_num;
+extern uint qnx_noreply_low_watermark;
+extern uint qnx_direct_copy_min_size;
+extern uint qnx_lockfree_enqueue;
+extern uint qnx_max_pulses_per_channel;
+
+
+/**
+ * @return the time left until the deadline for the given blocking state
+ *         (QNX_TIMEOUT_xxx), KTIME_MAX if the deadline doesn't apply.
+ */
+static inline
+ktime_t qnx_timeout_remaining(const struct qnx_io_timeout* timeout, int state)
+{
+   s64 remaining;
+   
+   if (!(timeout->flags & state) || timeout->deadline > KTIME_MAX)
+      return ns_to_ktime(KTIME_MAX);
+   
+   remaining = (s64)timeout->deadline - ktime_to_ns(ktime_get());
+   
+   return ns_to_ktime(remaining > 0 ? remaining : 0);
+}
 
 
 struct qnx_pollfd
@@ -35,6 +62,8 @@ struct qnx_pollfd
    
    struct file* file;
    int chid;   
+   
+   struct rcu_head rcu;
 };
 
 
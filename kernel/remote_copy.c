@@ -0,0 +1,226 @@
+#include "remote_copy.h"
+
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <asm/uaccess.h>
+
+#include "qnxcomm_internal.h"
+
+
+/// number of remote pages pinned at once, the page array lives on the stack
+#define QNX_REMOTE_COPY_PAGES 16
+
+
+int qnx_iovec_buf_import(struct qnx_iovec_buf* buf, const struct iovec* uiov, int nr_segs)
+{
+   buf->iov = buf->fast_iov;
+   buf->nr_segs = 0;
+   
+   if (unlikely(nr_segs < 0 || nr_segs > UIO_MAXIOV))
+      return -EINVAL;
+   
+   if (unlikely(nr_segs > QNX_FAST_IOVEC_LEN))
+   {
+      buf->iov = (struct iovec*)kmalloc(sizeof(struct iovec) * nr_segs, GFP_USER);
+      if (unlikely(!buf->iov))
+         return -ENOMEM;
+   }
+   
+   // keep nr_segs at 0 on failure, the release still frees the array
+   if (unlikely(copy_from_user(buf->iov, uiov, sizeof(struct iovec) * nr_segs)))
+      return -EFAULT;
+      
+   buf->nr_segs = nr_segs;
+   return 0;
+}
+
+
+void qnx_iovec_buf_release(struct qnx_iovec_buf* buf)
+{
+   if (buf->iov != buf->fast_iov)
+      kfree(buf->iov);
+      
+   buf->iov = buf->fast_iov;
+   buf->nr_segs = 0;
+}
+
+
+/// empty segments are skipped so iov always points to the next byte, else the copy loops would never advance
+static inline
+void qnx_iov_iter_skip_empty(struct qnx_iov_iter* iter)
+{
+   while (iter->nr_segs > 0 && iter->iov->iov_len == 0)
+   {
+      ++iter->iov;
+      --iter->nr_segs;
+   }
+}
+
+
+static inline
+void qnx_iov_iter_advance(struct qnx_iov_iter* iter, size_t len)
+{
+   while (len > 0 && iter->nr_segs > 0)
+   {
+      size_t n = min(len, iter->iov->iov_len - iter->iov_offset);
+
+      iter->iov_offset += n;
+      len -= n;
+
+      if (iter->iov_offset == iter->iov->iov_len)
+      {
+         ++iter->iov;
+         --iter->nr_segs;
+         iter->iov_offset = 0;
+         
+         qnx_iov_iter_skip_empty(iter);
+      }
+   }
+}
+
+
+void qnx_iov_iter_init(struct qnx_iov_iter* iter, const struct iovec* iov, unsigned long nr_segs, size_t offset)
+{
+   iter->iov = iov;
+   iter->nr_segs = nr_segs;
+   iter->iov_offset = 0;
+
+   qnx_iov_iter_skip_empty(iter);
+   qnx_iov_iter_advance(iter, offset);
+}
+
+
+int qnx_iov_iter_copy_to_user(struct qnx_iov_iter* iter, const void* kbuf, size_t len)
+{
+   while (len > 0 && iter->nr_segs > 0)
+   {
+      size_t n = min(len, iter->iov->iov_len - iter->iov_offset);
+
+      if (unlikely(copy_to_user(iter->iov->iov_base + iter->iov_offset, kbuf, n)))
+         return -EFAULT;
+
+      kbuf += n;
+      len -= n;
+
+      qnx_iov_iter_advance(iter, n);
+   }
+
+   return 0;
+}
+
+
+int qnx_iov_iter_copy_from_user(void* kbuf, struct qnx_iov_iter* iter, size_t len)
+{
+   while (len > 0 && iter->nr_segs > 0)
+   {
+      size_t n = min(len, iter->iov->iov_len - iter->iov_offset);
+
+      if (unlikely(copy_from_user(kbuf, iter->iov->iov_base + iter->iov_offset, n)))
+         return -EFAULT;
+
+      kbuf += n;
+      len -= n;
+
+      qnx_iov_iter_advance(iter, n);
+   }
+
+   return 0;
+}
+
+
+static
+ssize_t qnx_remote_copy(struct task_struct* task, struct qnx_iov_iter* remote, struct qnx_iov_iter* local, size_t len, int write)
+{
+   struct page* pages[QNX_REMOTE_COPY_PAGES];
+   struct mm_struct* mm;
+
+   ssize_t copied = 0;
+   int rc = 0;
+
+   mm = get_task_mm(task);
+   if (unlikely(!mm))
+      return -ESRCH;
+
+   while (len > 0 && remote->nr_segs > 0 && local->nr_segs > 0)
+   {
+      unsigned long addr = (unsigned long)remote->iov->iov_base + remote->iov_offset;
+      size_t offset = addr & ~PAGE_MASK;
+      size_t chunk;
+      long nr_pages;
+      long pinned;
+      long i;
+
+      chunk = min(len, remote->iov->iov_len - remote->iov_offset);
+      chunk = min(chunk, QNX_REMOTE_COPY_PAGES * PAGE_SIZE - offset);
+
+      nr_pages = DIV_ROUND_UP(offset + chunk, PAGE_SIZE);
+
+      qnx_mmap_read_lock(mm);
+      pinned = qnx_get_user_pages_remote(task, mm, addr & PAGE_MASK, nr_pages, write, pages);
+      qnx_mmap_read_unlock(mm);
+
+      if (unlikely(pinned <= 0))
+      {
+         rc = -EFAULT;
+         break;
+      }
+
+      // copy what we got, the next round will fail on the missing page
+      if (unlikely(pinned < nr_pages))
+         chunk = pinned * PAGE_SIZE - offset;
+
+      for (i=0; i<pinned; ++i)
+      {
+         size_t n = min(chunk, PAGE_SIZE - offset);
+
+         if (likely(rc == 0))
+         {
+            void* kaddr = kmap(pages[i]);
+
+            if (write)
+               rc = qnx_iov_iter_copy_from_user(kaddr + offset, local, n);
+            else
+               rc = qnx_iov_iter_copy_to_user(local, kaddr + offset, n);
+
+            kunmap(pages[i]);
+
+            if (write)
+               set_page_dirty_lock(pages[i]);
+
+            if (likely(rc == 0))
+            {
+               qnx_iov_iter_advance(remote, n);
+
+               copied += n;
+               len -= n;
+            }
+         }
+
+         put_page(pages[i]);
+
+         chunk -= n;
+         offset = 0;
+      }
+
+      if (unlikely(rc < 0))
+         break;
+   }
+
+   mmput(mm);
+
+   return rc < 0 ? rc : copied;
+}
+
+
+ssize_t qnx_remote_copy_from(struct task_struct* task, struct qnx_iov_iter* remote, struct qnx_iov_iter* local, size_t len)
+{
+   return qnx_remote_copy(task, remote, local, len, 0);
+}
+
+
+ssize_t qnx_remote_copy_to(struct task_struct* task, struct qnx_iov_iter* remote, struct qnx_iov_iter* local, size_t len)
+{
+   return qnx_remote_copy(task, remote, local, len, 1);
+}
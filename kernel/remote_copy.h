@@ -0,0 +1,79 @@
+#ifndef __QNXCOMM_REMOTE_COPY_H
+#define __QNXCOMM_REMOTE_COPY_H
+
+
+#include <linux/types.h>
+#include <linux/uio.h>
+
+
+// forward decls
+struct task_struct;
+
+
+/// iovec arrays up to this length are imported without allocation
+#define QNX_FAST_IOVEC_LEN 16
+
+
+/**
+ * Cursor into an iovec array. The array itself must reside in kernel
+ * memory, the segments point to userspace memory (either the current
+ * task's or the remote task's, depending on usage).
+ */
+struct qnx_iov_iter
+{
+   const struct iovec* iov;
+   unsigned long nr_segs;
+
+   size_t iov_offset;   ///< offset within the current segment
+};
+
+
+/**
+ * An iovec array copied from userspace. Short arrays are stored within
+ * the structure itself, i.e. on the caller's stack.
+ */
+struct qnx_iovec_buf
+{
+   struct iovec* iov;
+   unsigned long nr_segs;
+   
+   struct iovec fast_iov[QNX_FAST_IOVEC_LEN];
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// @return 0, -EINVAL if @c nr_segs is negative or above UIO_MAXIOV, -ENOMEM or -EFAULT
+int qnx_iovec_buf_import(struct qnx_iovec_buf* buf, const struct iovec* uiov, int nr_segs);
+
+void qnx_iovec_buf_release(struct qnx_iovec_buf* buf);
+
+
+void qnx_iov_iter_init(struct qnx_iov_iter* iter, const struct iovec* iov, unsigned long nr_segs, size_t offset);
+
+/// copy kernel buffer to the current task's userspace, @return 0 or -EFAULT
+int qnx_iov_iter_copy_to_user(struct qnx_iov_iter* iter, const void* kbuf, size_t len);
+
+/// copy the current task's userspace to a kernel buffer, @return 0 or -EFAULT
+int qnx_iov_iter_copy_from_user(void* kbuf, struct qnx_iov_iter* iter, size_t len);
+
+
+/**
+ * Copy data from the address space of @c task described by @c remote
+ * to the current task's userspace described by @c local. The remote
+ * pages are pinned in small batches, so no intermediate kernel buffer
+ * is needed.
+ *
+ * @return number of bytes copied or a negative error code.
+ */
+ssize_t qnx_remote_copy_from(struct task_struct* task, struct qnx_iov_iter* remote, struct qnx_iov_iter* local, size_t len);
+
+/**
+ * Same as above, but in the other direction: copy from the current
+ * task's userspace into the address space of @c task.
+ */
+ssize_t qnx_remote_copy_to(struct task_struct* task, struct qnx_iov_iter* remote, struct qnx_iov_iter* local, size_t len);
+
+
+#endif   // __QNXCOMM_REMOTE_COPY_H
@@ -0,0 +1,103 @@
+#include "submit_ring.h"
+
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "qnxcomm_internal.h"
+
+
+struct qnx_submit_ring* qnx_submit_ring_create(pid_t sender_pid, int coid, pid_t receiver_pid, int chid)
+{
+   struct qnx_submit_ring* ring = (struct qnx_submit_ring*)kmalloc(sizeof(struct qnx_submit_ring), GFP_USER);
+   if (unlikely(!ring))
+      return 0;
+      
+   // zeroed and suitable for remap_vmalloc_range
+   ring->hdr = (struct qnx_ring_header*)vmalloc_user(sizeof(struct qnx_ring_header));
+   if (unlikely(!ring->hdr))
+   {
+      kfree(ring);
+      return 0;
+   }
+   
+   INIT_LIST_HEAD(&ring->proc_hook);
+   INIT_LIST_HEAD(&ring->chnl_hook);
+   kref_init(&ring->refcnt);
+   
+   ring->head = 0;
+   
+   ring->sender_pid = sender_pid;
+   ring->coid = coid;
+   ring->receiver_pid = receiver_pid;
+   ring->chid = chid;
+   
+   return ring;
+}
+
+
+static 
+void qnx_submit_ring_free(struct kref* refcount)
+{
+   struct qnx_submit_ring* ring = container_of(refcount, struct qnx_submit_ring, refcnt);
+   
+   // pages still mapped by the sender stay alive until munmap
+   vfree(ring->hdr);
+   kfree(ring);
+}
+
+
+void qnx_submit_ring_release(struct qnx_submit_ring* ring)
+{
+   kref_put(&ring->refcnt, &qnx_submit_ring_free);
+}
+
+
+int qnx_submit_ring_pending(struct qnx_submit_ring* ring)
+{
+   u32 tail = smp_load_acquire(&ring->hdr->tail);
+   
+   // a broken sender must not make us read beyond the ring, drop everything
+   if (unlikely(tail - ring->head > QNX_RING_SLOTS))
+   {
+      ring->head = tail;
+      smp_store_release(&ring->hdr->head, ring->head);
+   }
+   
+   return tail != ring->head;
+}
+
+
+/**
+ * Tell the sender to ring the doorbell for the next slot. Returns 1 if
+ * a slot got published meanwhile, i.e. there is no need to sleep.
+ */
+int qnx_submit_ring_arm(struct qnx_submit_ring* ring)
+{
+   ACCESS_ONCE(ring->hdr->need_wakeup) = 1;
+   
+   // pairs with the sender's barrier between publishing tail and reading need_wakeup
+   smp_mb();
+   
+   if (qnx_submit_ring_pending(ring))
+   {
+      ACCESS_ONCE(ring->hdr->need_wakeup) = 0;
+      return 1;
+   }
+   
+   return 0;
+}
+
+
+const struct qnx_ring_slot* qnx_submit_ring_front(struct qnx_submit_ring* ring)
+{
+   return &ring->hdr->slots[ring->head & (QNX_RING_SLOTS - 1)];
+}
+
+
+void qnx_submit_ring_pop(struct qnx_submit_ring* ring)
+{
+   ++ring->head;
+   
+   // the slot may be reused by the sender from now on
+   smp_store_release(&ring->hdr->head, ring->head);
+}
@@ -0,0 +1,53 @@
+#ifndef __QNXCOMM_SUBMIT_RING_H
+#define __QNXCOMM_SUBMIT_RING_H
+
+
+#include <linux/list.h>
+#include <linux/kref.h>
+#include <linux/types.h>
+
+#include "qnxcomm_driver.h"
+
+
+/**
+ * Kernel side of a connection's submission ring. The ring is referenced 
+ * by the sending process (for ConnectDetach) and by the receiving channel
+ * (for MsgReceive).
+ */
+struct qnx_submit_ring
+{
+   struct list_head proc_hook;    ///< in sender's process entry
+   struct list_head chnl_hook;    ///< in receiver's channel, protected by the channel's waiting_lock
+   struct kref refcnt;
+   
+   struct qnx_ring_header* hdr;   ///< shared with userspace, never trust its contents
+   u32 head;                      ///< private copy of hdr->head
+   
+   pid_t sender_pid;
+   int coid;
+   
+   pid_t receiver_pid;
+   int chid;
+};
+
+
+// ---------------------------------------------------------------------
+
+
+/// construction/destruction
+struct qnx_submit_ring* qnx_submit_ring_create(pid_t sender_pid, int coid, pid_t receiver_pid, int chid);
+
+void qnx_submit_ring_release(struct qnx_submit_ring* ring);
+
+
+/// consumer side, must be called with the channel's waiting_lock held
+int qnx_submit_ring_pending(struct qnx_submit_ring* ring);
+
+int qnx_submit_ring_arm(struct qnx_submit_ring* ring);
+
+const struct qnx_ring_slot* qnx_submit_ring_front(struct qnx_submit_ring* ring);
+
+void qnx_submit_ring_pop(struct qnx_submit_ring* ring);
+
+
+#endif   // __QNXCOMM_SUBMIT_RING_H
@@ -0,0 +1,161 @@
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "qnxcomm.h"
+
+
+/**
+ * Shows the number of kernel heap allocations per message round trip
+ * for different message sizes and message types. Needs the statistics
+ * exported by the kernel module in /proc/qnxcomm/stats.
+ */
+
+namespace {
+
+const int NUM_ROUNDS = 100000;
+
+
+long get_allocations()
+{
+   std::ifstream in("/proc/qnxcomm/stats");
+   std::string name;
+   long value;
+
+   while(in >> name >> value)
+   {
+      if (name == "allocations:")
+         return value;
+   }
+
+   return -1;
+}
+
+
+double now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+void server(int chid, int size, int rounds)
+{
+   std::vector<char> buf(size);
+
+   for (int i=0; i<rounds; ++i)
+   {
+      int rcvid = MsgReceive(chid, &buf[0], size, 0);
+
+      if (rcvid > 0)
+         MsgReply(rcvid, 0, &buf[0], 4);
+   }
+}
+
+
+void report(const char* what, int size, long allocs, double start)
+{
+   double elapsed = now_us() - start;
+
+   printf("%-16s %7d bytes: %6.2f allocations/round trip, %7.2f us/round trip\n",
+          what, size, (double)allocs / NUM_ROUNDS, elapsed / NUM_ROUNDS);
+}
+
+
+void bench_msgsend(int chid, int coid, int size)
+{
+   std::vector<char> buf(size, 'a');
+   char reply[4];
+
+   std::thread t(&server, chid, size, NUM_ROUNDS);
+
+   long before = get_allocations();
+   double start = now_us();
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+      MsgSend(coid, &buf[0], size, reply, sizeof(reply));
+
+   report("MsgSend", size, get_allocations() - before, start);
+
+   t.join();
+}
+
+
+void bench_noreply(int chid, int coid, int size)
+{
+   std::vector<char> buf(size, 'a');
+
+   std::thread t(&server, chid, size, NUM_ROUNDS);
+
+   long before = get_allocations();
+   double start = now_us();
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+      MsgSendNoReply(coid, &buf[0], size);
+
+   t.join();
+
+   report("MsgSendNoReply", size, get_allocations() - before, start);
+}
+
+
+/// retries while the channel's pulse budget is used up, the receiver catches up meanwhile
+void send_pulse(int coid, int value)
+{
+   while (MsgSendPulse(coid, 0, 1, value) < 0 && errno == EAGAIN)
+      sched_yield();
+}
+
+
+void bench_pulse(int chid, int coid)
+{
+   std::thread t(&server, chid, sizeof(struct _pulse), NUM_ROUNDS);
+
+   long before = get_allocations();
+   double start = now_us();
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+      send_pulse(coid, i);
+
+   t.join();
+
+   report("MsgSendPulse", sizeof(struct _pulse), get_allocations() - before, start);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+   if (get_allocations() < 0)
+   {
+      fprintf(stderr, "kernel module statistics not available\n");
+      return 1;
+   }
+
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+
+   const int sizes[] = { 16, 128, 1024, 65536 };
+
+   for (unsigned i=0; i<sizeof(sizes)/sizeof(sizes[0]); ++i)
+      bench_msgsend(chid, coid, sizes[i]);
+
+   bench_noreply(chid, coid, 16);
+   bench_noreply(chid, coid, 1024);
+
+   bench_pulse(chid, coid);
+
+   ConnectDetach(coid);
+   ChannelDestroy(chid);
+
+   return 0;
+}
@@ -0,0 +1,86 @@
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+
+#include "qnxcomm.h"
+
+
+/**
+ * Measures the ConnectAttach/ConnectDetach throughput of one and of several 
+ * threads while a number of other connections is kept open. Note that the 
+ * number of open connections is limited by the kernel module parameter 
+ * @c max_connections.
+ */
+
+namespace {
+
+const int NUM_ROUNDS = 100000;
+const int NUM_THREADS = 4;
+
+
+double now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+void attach_detach(int chid, int rounds)
+{
+   for (int i=0; i<rounds; ++i)
+   {
+      int coid = ConnectAttach(0, 0, chid, 0, 0);
+
+      if (coid > 0)
+         ConnectDetach(coid);
+   }
+}
+
+
+void bench(int chid, size_t open, int threads)
+{
+   std::vector<std::thread> t;
+
+   double start = now_us();
+
+   for (int i=0; i<threads; ++i)
+      t.push_back(std::thread(&attach_detach, chid, NUM_ROUNDS / threads));
+
+   for (size_t i=0; i<t.size(); ++i)
+      t[i].join();
+
+   double elapsed = now_us() - start;
+
+   printf("%4zu open, %d thread(s): %10.0f attach+detach/s, %7.2f us each\n", 
+          open, threads, NUM_ROUNDS * 1000000.0 / elapsed, elapsed / NUM_ROUNDS);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+   const size_t counts[] = { 0, 60, 120, 240 };
+   std::vector<int> coids;
+
+   int chid = ChannelCreate(0);
+
+   for (unsigned i=0; i<sizeof(counts)/sizeof(counts[0]); ++i)
+   {
+      while (coids.size() < counts[i])
+         coids.push_back(ConnectAttach(0, 0, chid, 0, 0));
+
+      bench(chid, coids.size(), 1);
+      bench(chid, coids.size(), NUM_THREADS);
+   }
+
+   for (size_t i=0; i<coids.size(); ++i)
+      ConnectDetach(coids[i]);
+
+   ChannelDestroy(chid);
+
+   return 0;
+}
@@ -0,0 +1,127 @@
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "qnxcomm.h"
+
+
+/**
+ * Measures the pulse throughput of 1 to 64 threads sending to a single
+ * channel, drained by one receiver with MsgReceiveBatch. If the kernel
+ * module parameter @c lockfree_enqueue is writable (run as root), both the
+ * lock-free and the lock based enqueue are measured.
+ */
+
+namespace {
+
+const int NUM_PULSES = 256000;
+const int BATCH_SIZE = 64;
+
+const char* const PARAM = "/sys/module/qnxcomm/parameters/lockfree_enqueue";
+
+
+double now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+bool set_lockfree(int on)
+{
+   FILE* f = fopen(PARAM, "w");
+
+   if (!f)
+      return false;
+
+   fprintf(f, "%d\n", on);
+
+   return fclose(f) == 0;
+}
+
+
+/// retries while the channel's pulse budget is used up, the receiver catches up meanwhile
+void send_pulse(int coid, int value)
+{
+   while (MsgSendPulse(coid, 0, 1, value) < 0 && errno == EAGAIN)
+      sched_yield();
+}
+
+
+void producer(int chid, int pulses)
+{
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+
+   for (int i=0; i<pulses; ++i)
+      send_pulse(coid, i);
+
+   ConnectDetach(coid);
+}
+
+
+void bench(const char* mode, int threads)
+{
+   std::vector<std::thread> t;
+   char buf[BATCH_SIZE * sizeof(struct _pulse)];
+   struct _msg_info infos[BATCH_SIZE];
+
+   int chid = ChannelCreate(0);
+   int pulses = NUM_PULSES / threads;
+   int received = 0;
+
+   double start = now_us();
+
+   for (int i=0; i<threads; ++i)
+      t.push_back(std::thread(&producer, chid, pulses));
+
+   while (received < pulses * threads)
+   {
+      int rc = MsgReceiveBatch(chid, buf, sizeof(buf), infos, BATCH_SIZE);
+
+      if (rc < 0)
+         break;
+
+      received += rc;
+   }
+
+   double elapsed = now_us() - start;
+
+   for (size_t i=0; i<t.size(); ++i)
+      t[i].join();
+
+   printf("%-9s %2d producer(s): %10.0f pulses/s, %7.3f us each\n",
+          mode, threads, received * 1000000.0 / elapsed, elapsed / received);
+
+   ChannelDestroy(chid);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+   const int counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+   bool toggle = set_lockfree(1);
+
+   if (!toggle)
+      printf("%s not writable, measuring the current mode only\n", PARAM);
+
+   for (unsigned i=0; i<sizeof(counts)/sizeof(counts[0]); ++i)
+   {
+      bench(toggle ? "lock-free" : "current", counts[i]);
+
+      if (toggle && set_lockfree(0))
+      {
+         bench("locked", counts[i]);
+         set_lockfree(1);
+      }
+   }
+
+   return 0;
+}
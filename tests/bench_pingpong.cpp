@@ -0,0 +1,103 @@
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include "qnxcomm.h"
+
+
+/**
+ * Measures the MsgSend round trip latency between a client and a server 
+ * thread, with the server either replying via MsgReply and MsgReceive or
+ * via MsgReplyReceive. Prints the median and 99th percentile latency and 
+ * the fraction of round trips where client and server ended up on 
+ * different cpus.
+ */
+
+namespace {
+
+const int NUM_ROUNDS = 100000;
+
+
+double now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+void server(int chid, bool fused)
+{
+   int buf[2];
+   int rcvid = 0;
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+   {
+      if (fused)
+      {
+         rcvid = MsgReplyReceive(rcvid, 0, buf, sizeof(buf), chid, buf, sizeof(buf), 0);
+      }
+      else
+      {
+         rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+         if (rcvid > 0 && i < NUM_ROUNDS - 1)
+            MsgReply(rcvid, 0, buf, sizeof(buf));
+      }
+
+      // tell the client where we are running
+      buf[1] = sched_getcpu();
+   }
+
+   MsgReply(rcvid, 0, buf, sizeof(buf));
+}
+
+
+void bench(int chid, int coid, bool fused)
+{
+   std::vector<double> latencies(NUM_ROUNDS);
+   int buf[2] = { 0, 0 };
+   int remote = 0;
+
+   std::thread t(&server, chid, fused);
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+   {
+      double start = now_us();
+      MsgSend(coid, buf, sizeof(buf), buf, sizeof(buf));
+      latencies[i] = now_us() - start;
+
+      if (buf[1] != sched_getcpu())
+         ++remote;
+   }
+
+   t.join();
+
+   std::sort(latencies.begin(), latencies.end());
+
+   printf("%-24s median %7.2f us, 99%% %7.2f us, cross cpu %5.1f%%\n",
+          fused ? "MsgReplyReceive" : "MsgReceive + MsgReply",
+          latencies[NUM_ROUNDS / 2], latencies[NUM_ROUNDS * 99 / 100],
+          100.0 * remote / NUM_ROUNDS);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+
+   bench(chid, coid, false);
+   bench(chid, coid, true);
+
+   ConnectDetach(coid);
+   ChannelDestroy(chid);
+
+   return 0;
+}
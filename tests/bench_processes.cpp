@@ -0,0 +1,134 @@
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "qnxcomm.h"
+
+
+/**
+ * Measures the MsgSend round trip latency and the MsgSendPulse latency 
+ * while an increasing number of other processes is attached to the kernel 
+ * module. The latency should not depend on the number of processes.
+ */
+
+namespace {
+
+const int NUM_ROUNDS = 50000;
+
+
+double now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+void server(int chid, int rounds)
+{
+   char buf[16];
+
+   for (int i=0; i<rounds; ++i)
+   {
+      int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+
+      if (rcvid > 0)
+         MsgReply(rcvid, 0, buf, 4);
+   }
+}
+
+
+/// the child only registers itself within the kernel module
+pid_t spawn_idle_process()
+{
+   pid_t pid = fork();
+
+   if (pid == 0)
+   {
+      ChannelCreate(0);
+      pause();
+      _exit(0);
+   }
+
+   return pid;
+}
+
+
+/// retries while the channel's pulse budget is used up, the receiver catches up meanwhile
+void send_pulse(int coid, int value)
+{
+   while (MsgSendPulse(coid, 0, 1, value) < 0 && errno == EAGAIN)
+      sched_yield();
+}
+
+
+void bench(int chid, int coid, size_t processes)
+{
+   char buf[16] = "Hallo Welt";
+
+   std::thread t(&server, chid, NUM_ROUNDS);
+
+   double start = now_us();
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+      MsgSend(coid, buf, sizeof(buf), buf, sizeof(buf));
+
+   double send = (now_us() - start) / NUM_ROUNDS;
+
+   t.join();
+   t = std::thread(&server, chid, NUM_ROUNDS);
+
+   start = now_us();
+
+   for (int i=0; i<NUM_ROUNDS; ++i)
+      send_pulse(coid, i);
+
+   double pulse = (now_us() - start) / NUM_ROUNDS;
+
+   t.join();
+
+   printf("%4zu processes: %7.2f us/MsgSend, %7.2f us/MsgSendPulse\n", processes, send, pulse);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+   const size_t counts[] = { 0, 50, 100, 200, 400 };
+   std::vector<pid_t> children;
+
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+
+   for (unsigned i=0; i<sizeof(counts)/sizeof(counts[0]); ++i)
+   {
+      while (children.size() < counts[i])
+         children.push_back(spawn_idle_process());
+
+      // give the children time to attach
+      usleep(100000);
+
+      bench(chid, coid, children.size());
+   }
+
+   for (size_t i=0; i<children.size(); ++i)
+   {
+      kill(children[i], SIGTERM);
+      waitpid(children[i], 0, 0);
+   }
+
+   ConnectDetach(coid);
+   ChannelDestroy(chid);
+
+   return 0;
+}
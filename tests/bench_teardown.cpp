@@ -0,0 +1,131 @@
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "qnxcomm.h"
+
+
+/**
+ * Measures how long it takes until a killed server process with many 
+ * channels, connections and blocked clients is gone and until all its 
+ * clients are unblocked. One client is reply blocked, the others are 
+ * send blocked. Note that the number of connections is limited by the 
+ * kernel module parameter @c max_connections.
+ */
+
+namespace {
+
+double now_us()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+/// the child creates the channels, connects to them and receives a single message
+pid_t spawn_server(int channels, int connections, std::vector<int>& chids)
+{
+   int fds[2];
+   
+   if (pipe(fds) < 0)
+      return -1;
+
+   pid_t pid = fork();
+
+   if (pid == 0)
+   {
+      char buf[16];
+      
+      close(fds[0]);
+      
+      for (int i=0; i<channels; ++i)
+         chids.push_back(ChannelCreate(0));
+         
+      for (int i=0; i<connections; ++i)
+         ConnectAttach(0, 0, chids[i % channels], 0, 0);
+         
+      (void)write(fds[1], &chids[0], sizeof(int) * chids.size());
+      close(fds[1]);
+      
+      MsgReceive(chids[0], buf, sizeof(buf), 0);
+      pause();
+      _exit(0);
+   }
+   
+   close(fds[1]);
+   
+   chids.resize(channels);
+   (void)read(fds[0], &chids[0], sizeof(int) * chids.size());
+   close(fds[0]);
+
+   return pid;
+}
+
+
+void client(pid_t pid, int chid, double* end)
+{
+   char buf[16] = "Hallo Welt";
+   
+   int coid = ConnectAttach(0, pid, chid, 0, 0);
+   
+   MsgSend(coid, buf, sizeof(buf), buf, sizeof(buf));
+   *end = now_us();
+   
+   ConnectDetach(coid);
+}
+
+
+void bench(int channels, int connections, int clients)
+{
+   std::vector<int> chids;
+   std::vector<std::thread> t;
+   std::vector<double> ends(clients);
+   
+   pid_t pid = spawn_server(channels, connections, chids);
+   
+   for (int i=0; i<clients; ++i)
+      t.push_back(std::thread(&client, pid, chids[i % channels], &ends[i]));
+   
+   // let the clients block
+   usleep(200000);
+   
+   double start = now_us();
+   
+   kill(pid, SIGKILL);
+   waitpid(pid, 0, 0);
+   
+   double exited = now_us() - start;
+   
+   for (size_t i=0; i<t.size(); ++i)
+      t[i].join();
+   
+   double unblocked = 0;
+   
+   for (size_t i=0; i<ends.size(); ++i)
+      unblocked = std::max(unblocked, ends[i] - start);
+
+   printf("%4d channels, %4d connections, %3d clients: %9.0f us until exit, %9.0f us until all clients unblocked\n", 
+          channels, connections, clients, exited, unblocked);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+   bench(1, 1, 1);
+   bench(10, 10, 8);
+   bench(100, 100, 32);
+   bench(500, 250, 64);
+   bench(2000, 250, 128);
+
+   return 0;
+}
@@ -26,3 +26,33 @@ TEST(MsgSend, disconnected)
    EXPECT_EQ(0, ConnectDetach(coid));  
 }
 
+
+TEST(MsgSend, destroyed_while_blocked) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   std::thread t([coid]() {
+      char buf[80];   
+      strcpy(buf, "Hallo Welt");
+      
+      // the connection still refers to the channel, but the sender must not block forever
+      int rc = MsgSend(coid, buf, strlen(buf) + 1, buf, sizeof(buf));
+      int error = errno;
+      EXPECT_EQ(-1, rc);
+      EXPECT_EQ(ESRCH, error);   
+   });
+   
+   usleep(100000);
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   
+   t.join();
+   
+   EXPECT_EQ(-1, MsgSendPulse(coid, 0, 1, 2));
+   EXPECT_EQ(EBADF, errno);   
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "qnxcomm.h"
+
+
+namespace {
+
+void senderthread(int coid)
+{
+   char buf[80];
+   strcpy(buf, "Hallo Welt");
+   
+   EXPECT_EQ(0, MsgSend(coid, buf, strlen(buf) + 1, buf, sizeof(buf)));
+}
+
+}
+
+
+TEST(MsgReceiveBatch, basics) 
+{
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, 4711));
+   EXPECT_EQ(0, MsgSendNoReply(coid, "abc", 4));
+   EXPECT_EQ(0, MsgSendNoReply(coid, "Hallo Welt", 11));
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 2, 4712));
+   
+   char buf[256];
+   struct _msg_info infos[8];
+   
+   EXPECT_EQ(4, MsgReceiveBatch(chid, buf, sizeof(buf), infos, 8));
+   
+   int offset = 0;
+   
+   struct _pulse* pulse = (struct _pulse*)(buf + offset);
+   EXPECT_EQ(0, infos[0].flags & QNX_FLAG_NOREPLY);
+   EXPECT_EQ(1, pulse->code);
+   EXPECT_EQ(4711, pulse->value.sival_int);
+   
+   offset = MsgReceiveBatchNext(offset, &infos[0]);
+   EXPECT_NE(0, infos[1].flags & QNX_FLAG_NOREPLY);
+   EXPECT_EQ(4, infos[1].msglen);
+   EXPECT_EQ(::getpid(), infos[1].pid);
+   EXPECT_EQ(0, strcmp(buf + offset, "abc"));
+   
+   offset = MsgReceiveBatchNext(offset, &infos[1]);
+   EXPECT_EQ(11, infos[2].msglen);
+   EXPECT_EQ(0, strcmp(buf + offset, "Hallo Welt"));
+   
+   offset = MsgReceiveBatchNext(offset, &infos[2]);
+   pulse = (struct _pulse*)(buf + offset);
+   EXPECT_EQ(2, pulse->code);
+   EXPECT_EQ(4712, pulse->value.sival_int);
+   
+   // limited by the number of infos and by the buffer size
+   for (int i=0; i<4; ++i)
+      EXPECT_EQ(0, MsgSendNoReply(coid, "abc", 4));
+      
+   EXPECT_EQ(2, MsgReceiveBatch(chid, buf, sizeof(buf), infos, 2));
+   EXPECT_EQ(1, MsgReceiveBatch(chid, buf, 8, infos, 8));
+   EXPECT_EQ(1, MsgReceiveBatch(chid, buf, sizeof(buf), infos, 8));
+   
+   // stops at a message which needs a reply
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 3, 0));
+   std::thread t(&senderthread, coid);
+   ::usleep(100000);
+   
+   EXPECT_EQ(1, MsgReceiveBatch(chid, buf, sizeof(buf), infos, 8));
+   EXPECT_EQ(0, MsgReceiveBatch(chid, buf, sizeof(buf), infos, 8));
+   
+   int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_EQ(0, MsgReply(rcvid, 0, 0, 0));
+   
+   t.join();
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
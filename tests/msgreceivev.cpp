@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "qnxcomm.h"
+
+
+namespace {
+
+struct Header
+{
+   int type;
+   int len;
+};
+
+
+void receiverthread(int chid)
+{
+   Header hdr;
+   char payload[80];
+   memset(payload, 0, sizeof(payload));
+   
+   // header and payload apart, no flat buffer
+   struct iovec riov[2] = { { &hdr, sizeof(hdr) }, { payload, sizeof(payload) } };
+   struct _msg_info info;
+   
+   int rcvid = MsgReceivev(chid, riov, 2, &info);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_EQ(1, hdr.type);
+   EXPECT_EQ(11, hdr.len);
+   EXPECT_STREQ("Hallo Welt", payload);
+   EXPECT_EQ(int(sizeof(hdr) + 11), info.msglen);
+   
+   // again from an offset, scattered over single bytes
+   char part[5];
+   struct iovec piov[5];
+   
+   for (int i=0; i<5; ++i)
+   {
+      piov[i].iov_base = part + i;
+      piov[i].iov_len = 1;
+   }
+   
+   EXPECT_EQ(5, MsgReadv(rcvid, piov, 5, sizeof(hdr) + 6));
+   EXPECT_EQ(0, memcmp(part, "Welt", 5));
+   
+   // the reply is gathered from its fragments
+   hdr.type = 2;
+   hdr.len = 7;
+   
+   struct iovec siov[3] = { { &hdr, sizeof(hdr) }, { (void*)"Sup", 3 }, { (void*)"er!", 4 } };
+   EXPECT_EQ(0, MsgReplyv(rcvid, 42, siov, 3));
+   
+   // more fragments than fit on the kernel stack
+   std::vector<char> big(4000);
+   std::vector<struct iovec> biov(big.size() / 100);
+   
+   for (size_t i=0; i<biov.size(); ++i)
+   {
+      biov[i].iov_base = &big[i * 100];
+      biov[i].iov_len = 100;
+   }
+   
+   rcvid = MsgReceivev(chid, &biov[0], biov.size(), 0);
+   EXPECT_GT(rcvid, 0);
+   
+   for (size_t i=0; i<big.size(); ++i)
+      EXPECT_EQ(char(i % 127), big[i]);
+      
+   EXPECT_EQ(0, MsgReplyv(rcvid, 0, &biov[0], biov.size()));
+}
+
+}
+
+
+TEST(MsgReceivev, basics) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+ 
+   std::thread t(&receiverthread, chid);
+   
+   char buf[80];
+   Header* hdr = (Header*)buf;
+   
+   hdr->type = 1;
+   hdr->len = 11;
+   strcpy(buf + sizeof(Header), "Hallo Welt");
+   
+   EXPECT_EQ(42, MsgSend(coid, buf, sizeof(Header) + 11, buf, sizeof(buf)));
+   EXPECT_EQ(2, hdr->type);
+   EXPECT_EQ(7, hdr->len);
+   EXPECT_STREQ("Super!", buf + sizeof(Header));
+   
+   std::vector<char> big(4000);
+   std::vector<char> reply(big.size());
+   
+   for (size_t i=0; i<big.size(); ++i)
+      big[i] = char(i % 127);
+   
+   EXPECT_EQ(0, MsgSend(coid, &big[0], big.size(), &reply[0], reply.size()));
+   EXPECT_TRUE(big == reply);
+   
+   t.join(); 
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+TEST(MsgReceivev, pulse) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 42, 4711));
+   
+   char buf[sizeof(struct _pulse)];
+   struct iovec riov[2] = { { buf, 4 }, { buf + 4, sizeof(buf) - 4 } };
+   
+   EXPECT_EQ(0, MsgReceivev(chid, riov, 2, 0));
+   
+   struct _pulse* pulse = (struct _pulse*)buf;
+   EXPECT_EQ(42, pulse->code);
+   EXPECT_EQ(4711, pulse->value.sival_int);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+TEST(MsgReceivev, errors) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   char buf[16];
+   struct iovec riov[1] = { { buf, sizeof(buf) } };
+   
+   EXPECT_EQ(-1, MsgReceivev(chid, riov, -1, 0));
+   EXPECT_EQ(EINVAL, errno);
+   
+   EXPECT_EQ(-1, MsgReceivev(4711, riov, 1, 0));
+   EXPECT_EQ(EBADF, errno);
+   
+   EXPECT_EQ(-1, MsgReplyv(4711, 0, riov, 1));
+   EXPECT_EQ(ESRCH, errno);
+   
+   EXPECT_EQ(-1, MsgReadv(4711, riov, 1, 0));
+   EXPECT_EQ(ESRCH, errno);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
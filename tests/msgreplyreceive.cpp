@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "qnxcomm.h"
+
+
+namespace {
+
+const int NUM_ROUNDS = 10;
+
+
+void serverthread(int chid)
+{
+   char buf[80];
+   struct _msg_info info;
+   int rcvid = 0;
+   
+   // the first call only receives
+   for (int i=0; i<NUM_ROUNDS; ++i)
+   {
+      int len = rcvid > 0 ? strlen(buf) + 1 : 0;
+      
+      rcvid = MsgReplyReceive(rcvid, i - 1, buf, len, chid, buf, sizeof(buf), &info);
+      EXPECT_GT(rcvid, 0);
+      EXPECT_EQ(::getpid(), info.pid);
+      EXPECT_EQ(0, strcmp(buf, "Hallo Welt"));
+      
+      strcpy(buf, "Super!");
+   }
+   
+   // invalid rcvid, nothing is received
+   EXPECT_EQ(-1, MsgReplyReceive(rcvid + 4711, 0, 0, 0, chid, buf, sizeof(buf), &info));
+   EXPECT_EQ(ESRCH, errno);
+   
+   EXPECT_EQ(0, MsgReply(rcvid, NUM_ROUNDS - 1, buf, strlen(buf) + 1));
+}
+
+}
+
+
+TEST(MsgReplyReceive, basics) 
+{
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   
+   std::thread t(&serverthread, chid);
+   
+   for (int i=0; i<NUM_ROUNDS; ++i)
+   {
+      char buf[80];
+      strcpy(buf, "Hallo Welt");
+      
+      EXPECT_EQ(i, MsgSend(coid, buf, strlen(buf) + 1, buf, sizeof(buf)));
+      EXPECT_EQ(0, strcmp(buf, "Super!"));
+   }
+   
+   t.join();
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
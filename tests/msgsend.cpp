@@ -179,3 +179,25 @@ TEST(MsgSend, zero_buffers)
    EXPECT_EQ(0, ConnectDetach(coid));  
 }
 
+
+
+TEST(MsgSend, bad_buffer) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   // small messages are checked by the kernel, too
+   const void* bad = (const void*)16;
+   
+   EXPECT_EQ(-1, MsgSend(coid, bad, 10, 0, 0));
+   EXPECT_EQ(EFAULT, errno);
+   
+   EXPECT_EQ(-1, MsgSendNoReply(coid, bad, 10));
+   EXPECT_EQ(EFAULT, errno);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "qnxcomm.h"
+
+
+TEST(MsgSendBatch, pulses) 
+{
+   int chid1 = ChannelCreate(0);
+   int chid2 = ChannelCreate(0);
+   
+   int coid1 = ConnectAttach(0, 0, chid1, 0, 0);
+   int coid2 = ConnectAttach(0, 0, chid2, 0, 0);
+   
+   // more than one chunk in the kernel, interleaved channels
+   struct _pulse_batch pulses[50];
+   
+   for (int i=0; i<50; ++i)
+   {
+      pulses[i].coid = i % 2 ? coid2 : coid1;
+      pulses[i].priority = 10;
+      pulses[i].code = 1;
+      pulses[i].value = i;
+   }
+   
+   EXPECT_EQ(50, MsgSendPulseBatch(pulses, 50));
+   
+   struct _pulse pulse;
+   
+   for (int i=0; i<50; i+=2)
+   {
+      EXPECT_EQ(0, MsgReceive(chid1, &pulse, sizeof(pulse), 0));
+      EXPECT_EQ(i, pulse.value.sival_int);
+      
+      EXPECT_EQ(0, MsgReceive(chid2, &pulse, sizeof(pulse), 0));
+      EXPECT_EQ(i + 1, pulse.value.sival_int);
+   }
+   
+   // entries before an invalid one are sent
+   pulses[3].coid = 4711;
+   EXPECT_EQ(3, MsgSendPulseBatch(pulses, 50));
+   
+   pulses[0].coid = 4711;
+   EXPECT_EQ(-1, MsgSendPulseBatch(pulses, 50));
+   EXPECT_EQ(EBADF, errno);
+   
+   EXPECT_EQ(0, ConnectDetach(coid1));  
+   EXPECT_EQ(0, ConnectDetach(coid2));  
+   EXPECT_EQ(0, ChannelDestroy(chid1));
+   EXPECT_EQ(0, ChannelDestroy(chid2));
+}
+
+
+TEST(MsgSendBatch, noreply) 
+{
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   
+   char large[1000];
+   memset(large, 'x', sizeof(large));
+   
+   struct _noreply_batch msgs[3] = {
+      { coid, "Hallo", 6 },
+      { coid, large, sizeof(large) },
+      { coid, "Welt", 5 }
+   };
+   
+   EXPECT_EQ(3, MsgSendNoReplyBatch(msgs, 3));
+   
+   char buf[1024];
+   struct _msg_info info;
+   
+   EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), &info), 0);
+   EXPECT_EQ(0, strcmp(buf, "Hallo"));
+   EXPECT_NE(0, info.flags & QNX_FLAG_NOREPLY);
+   
+   EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), &info), 0);
+   EXPECT_EQ(1000, info.msglen);
+   EXPECT_EQ(0, memcmp(buf, large, sizeof(large)));
+   
+   EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), &info), 0);
+   EXPECT_EQ(0, strcmp(buf, "Welt"));
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
+
+
+TEST(MsgSendBatch, noreplyPool) 
+{
+   int chid = ChannelCreate(QNX_CHF_NOREPLY_POOL);
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   int nbcoid = ConnectAttach(0, 0, chid, 0, QNX_COF_NONBLOCK);
+   
+   // fill the pool, then make room for a few messages
+   while (MsgSendNoReply(nbcoid, "x", 2) == 0);
+   EXPECT_EQ(EAGAIN, errno);
+   
+   char buf[80];
+   
+   for (int i=0; i<4; ++i)
+      EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), 0), 0);
+   
+   // the batch doesn't wait for the descriptors it holds itself
+   struct _noreply_batch msgs[16];
+   
+   for (int i=0; i<16; ++i)
+   {
+      msgs[i].coid = coid;
+      msgs[i].smsg = "Hallo";
+      msgs[i].sbytes = 6;
+   }
+   
+   uint64_t timeout = 50000000;
+   
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_SEND, 0, &timeout, 0));
+   EXPECT_EQ(4, MsgSendNoReplyBatch(msgs, 16));
+   
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_SEND, 0, &timeout, 0));
+   EXPECT_EQ(-1, MsgSendNoReplyBatch(msgs, 16));
+   EXPECT_EQ(ETIMEDOUT, errno);
+   
+   EXPECT_EQ(0, ConnectDetach(nbcoid));  
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
@@ -76,3 +76,206 @@ TEST(MsgSendNoReply, basics)
    EXPECT_EQ(0, ConnectDetach(coid));  
 }
 
+
+
+namespace {
+
+void poolreceiverthread(int chid)
+{
+   char buf[2048];
+   struct _msg_info info;
+   
+   // noreply message, pulse, large noreply message and normal message must keep their order
+   int rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_EQ(0, strcmp(buf, "first"));
+   EXPECT_NE(0, info.flags & QNX_FLAG_NOREPLY);   
+   
+   rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+   EXPECT_EQ(0, rcvid);
+   EXPECT_EQ(42, ((struct _pulse*)buf)->code);
+   
+   rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_EQ(1024, info.msglen);
+   EXPECT_EQ('x', buf[0]);
+   EXPECT_EQ('x', buf[1023]);
+   EXPECT_NE(0, info.flags & QNX_FLAG_NOREPLY);   
+   
+   rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_EQ(0, strcmp(buf, "last"));
+   EXPECT_EQ(0, info.flags & QNX_FLAG_NOREPLY);   
+   
+   EXPECT_EQ(0, MsgReply(rcvid, 0, 0, 0));
+}
+
+}
+
+
+TEST(MsgSendNoReply, pool) 
+{
+   int chid = ChannelCreate(QNX_CHF_NOREPLY_POOL);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+ 
+   char buf[1024];   
+   strcpy(buf, "first");
+   
+   EXPECT_EQ(0, MsgSendNoReply(coid, buf, strlen(buf) + 1));
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 42, 0));
+   
+   memset(buf, 'x', sizeof(buf));
+   EXPECT_EQ(0, MsgSendNoReply(coid, buf, sizeof(buf)));
+   
+   std::thread t(&poolreceiverthread, chid);
+   
+   strcpy(buf, "last");
+   EXPECT_EQ(0, MsgSend(coid, buf, strlen(buf) + 1, 0, 0));
+   
+   t.join(); 
+   
+   // the pool is released with the channel, pending messages included
+   EXPECT_EQ(0, MsgSendNoReply(coid, buf, 10));
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+namespace {
+
+/// default of the module parameter noreply_per_channel
+const int NOREPLY_PER_CHANNEL = 128;
+
+
+/// fills the channel until the noreply limit is reached
+int fill(int coid)
+{
+   int num = 0;
+   
+   while (MsgSendNoReply(coid, "x", 2) == 0)
+      ++num;
+   
+   EXPECT_EQ(EAGAIN, errno);
+   return num;
+}
+
+}
+
+
+TEST(MsgSendNoReply, nonblocking) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int notify_chid = ChannelCreate(0);
+   EXPECT_GT(notify_chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, QNX_COF_NONBLOCK);
+   EXPECT_GT(coid, 0);
+   
+   int notify_coid = ConnectAttach(0, 0, notify_chid, 0, 0);
+   EXPECT_GT(notify_coid, 0);
+   
+   EXPECT_EQ(NOREPLY_PER_CHANNEL, fill(coid));
+   
+   EXPECT_EQ(0, MsgNoReplyNotify(coid, notify_coid, 17, 4711));
+   
+   char buf[80];
+   struct _pulse* pulse = (struct _pulse*)buf;
+   
+   uint64_t timeout = 0;
+   
+   // no pulse before the queue drained below the low watermark (default: half)
+   for (int i=0; i<=NOREPLY_PER_CHANNEL / 2; ++i)
+   {
+      EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), 0), 0);
+      
+      if (i < NOREPLY_PER_CHANNEL / 2)
+      {
+         EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, 0, &timeout, 0));
+         EXPECT_EQ(-1, MsgReceive(notify_chid, buf, sizeof(buf), 0));
+         EXPECT_EQ(ETIMEDOUT, errno);
+      }
+   }
+   
+   EXPECT_EQ(0, MsgReceive(notify_chid, buf, sizeof(buf), 0));
+   EXPECT_EQ(17, pulse->code);
+   EXPECT_EQ(4711, pulse->value.sival_int);
+   
+   // there is space again
+   EXPECT_EQ(0, MsgSendNoReply(coid, "x", 2));
+   
+   // already below, so the pulse comes at once
+   EXPECT_EQ(0, MsgNoReplyNotify(coid, notify_coid, 18, 0));
+   EXPECT_EQ(0, MsgReceive(notify_chid, buf, sizeof(buf), 0));
+   EXPECT_EQ(18, pulse->code);
+   
+   EXPECT_EQ(-1, MsgNoReplyNotify(4711, notify_coid, 18, 0));
+   EXPECT_EQ(EBADF, errno);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ChannelDestroy(notify_chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ConnectDetach(notify_coid));  
+}
+
+
+TEST(MsgSendNoReply, blocking) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, QNX_COF_NONBLOCK);
+   EXPECT_GT(coid, 0);
+   
+   int blocking_coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(blocking_coid, 0);
+   
+   EXPECT_EQ(NOREPLY_PER_CHANNEL, fill(coid));
+   
+   // full, a send blocked deadline applies
+   uint64_t timeout = 10000000;   // 10ms
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_SEND, 0, &timeout, 0));
+   EXPECT_EQ(-1, MsgSendNoReply(blocking_coid, "y", 2));
+   EXPECT_EQ(ETIMEDOUT, errno);
+   
+   // the blocked sender is woken up by the receiver
+   std::thread t([blocking_coid]() {
+      EXPECT_EQ(0, MsgSendNoReply(blocking_coid, "y", 2));
+   });
+   
+   usleep(50000);
+   
+   char buf[80];
+   
+   for (int i=0; i<NOREPLY_PER_CHANNEL; ++i)
+   {
+      EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), 0), 0);
+      EXPECT_EQ(0, strcmp(buf, "x"));
+   }
+   
+   t.join();
+   
+   EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), 0), 0);
+   EXPECT_EQ(0, strcmp(buf, "y"));
+   
+   // a sender blocked on a full channel gets released when the channel vanishes
+   EXPECT_EQ(NOREPLY_PER_CHANNEL, fill(coid));
+   
+   std::thread t2([blocking_coid]() {
+      EXPECT_EQ(-1, MsgSendNoReply(blocking_coid, "y", 2));
+      EXPECT_EQ(ESRCH, errno);
+   });
+   
+   usleep(50000);
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   
+   t2.join();
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ConnectDetach(blocking_coid));  
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <thread>
+#include <iostream>
 
 #include "qnxcomm.h"
 
@@ -88,3 +89,180 @@ TEST_F(MsgSendPulseTest, basic)
    EXPECT_EQ(-1, rc);   
    EXPECT_EQ(errno, EBADF);
 }   
+
+
+TEST(MsgSendPulse, coalesce)
+{
+   int chid = ChannelCreate(QNX_CHF_COALESCE_PULSES);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   for (int i=1; i<=100; ++i)
+   {
+      EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, i));
+      EXPECT_EQ(0, MsgSendPulse(coid, 0, 2, -i));
+   }
+   
+   // another priority is queued separately
+   EXPECT_EQ(0, MsgSendPulse(coid, 10, 1, 4711));
+   
+   struct _pulse pulse;
+   
+   EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(1, pulse.code);
+   EXPECT_EQ(4711, pulse.value.sival_int);
+   
+   // one pulse per code with the latest value, in the order they were first sent
+   EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(1, pulse.code);
+   EXPECT_EQ(100, pulse.value.sival_int);
+   
+   EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(2, pulse.code);
+   EXPECT_EQ(-100, pulse.value.sival_int);
+   
+   // nothing left
+   uint64_t timeout = 10000000;
+   
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, 0, &timeout, 0));
+   EXPECT_EQ(-1, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(ETIMEDOUT, errno);
+   
+   // a received pulse is not updated anymore
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, 4712));
+   EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(4712, pulse.value.sival_int);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
+
+
+TEST(MsgSendPulse, budget)
+{
+   int budget = 0;
+   
+   FILE* f = fopen("/sys/module/qnxcomm/parameters/pulses_per_channel", "r");
+   if (f)
+   {
+      EXPECT_EQ(1, fscanf(f, "%d", &budget));
+      fclose(f);
+   }
+   
+   if (budget <= 0 || budget > 100000)
+   {
+      std::cout << "pulse budget unlimited or too large, skipped" << std::endl;
+      return;
+   }
+   
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   for (int i=0; i<budget; ++i)
+      EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, i));
+   
+   EXPECT_EQ(-1, MsgSendPulse(coid, 0, 1, budget));
+   EXPECT_EQ(EAGAIN, errno);
+   
+   // receiving gives the budget back
+   struct _pulse pulse;
+   EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(0, pulse.value.sival_int);
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, budget));
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
+
+
+TEST(MsgSendPulse, receivepulse)
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   char msg[] = "hello";
+   
+   EXPECT_EQ(0, MsgSendNoReply(coid, msg, sizeof(msg)));
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, 1));
+   EXPECT_EQ(0, MsgSendNoReply(coid, msg, sizeof(msg)));
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 2, 2));
+   
+   // messages are skipped, pulses come in order
+   struct _pulse pulse;
+   struct _msg_info info;
+   
+   EXPECT_EQ(0, MsgReceivePulse(chid, &pulse, sizeof(pulse), &info));
+   EXPECT_EQ(1, pulse.code);
+   EXPECT_EQ(1, pulse.value.sival_int);
+   EXPECT_EQ(coid, info.coid);
+   
+   EXPECT_EQ(0, MsgReceivePulse(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(2, pulse.code);
+   
+   uint64_t timeout = 10000000;
+   
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, 0, &timeout, 0));
+   EXPECT_EQ(-1, MsgReceivePulse(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(ETIMEDOUT, errno);
+   
+   // the messages are still there
+   char buf[16];
+   
+   EXPECT_LT(0, MsgReceive(chid, buf, sizeof(buf), 0));
+   EXPECT_STREQ(msg, buf);
+   EXPECT_LT(0, MsgReceive(chid, buf, sizeof(buf), 0));
+   
+   // MsgReceive gets pulses, too, in the order they were sent
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 3, 3));
+   EXPECT_EQ(0, MsgSendNoReply(coid, msg, sizeof(msg)));
+   
+   EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(3, pulse.code);
+   EXPECT_LT(0, MsgReceive(chid, buf, sizeof(buf), 0));
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
+
+
+TEST(MsgSendPulse, receivepulse_wakeup)
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   struct _pulse pulse;
+   pulse.code = 0;
+   
+   std::thread t([chid, &pulse]() {
+      EXPECT_EQ(0, MsgReceivePulse(chid, &pulse, sizeof(pulse), 0));
+   });
+   
+   usleep(50000);
+   
+   // a message doesn't wake up the pulse receiver
+   char msg[] = "hello";
+   EXPECT_EQ(0, MsgSendNoReply(coid, msg, sizeof(msg)));
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 42, 0));
+   t.join();
+   
+   EXPECT_EQ(42, pulse.code);
+   
+   char buf[16];
+   EXPECT_LT(0, MsgReceive(chid, buf, sizeof(buf), 0));
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <thread>
+#include <vector>
 
 #include "qnxcomm.h"
 
@@ -167,3 +168,56 @@ TEST(MsgSendv, noReplyData)
    EXPECT_EQ(0, ChannelDestroy(chid));
    EXPECT_EQ(0, ConnectDetach(coid));  
 }
+
+
+TEST(MsgSendv, emptySegments) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   // large enough to be copied directly from the sender
+   std::vector<char> big(8192);
+   
+   for (size_t i=0; i<big.size(); ++i)
+      big[i] = char(i % 127);
+ 
+   std::thread t([chid, &big]() {
+      char buf[80];
+      
+      int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+      EXPECT_GT(rcvid, 0);
+      EXPECT_EQ(0, strcmp(buf, "Hallo Welt"));
+      
+      struct iovec reply[3] = { { (void*)"Sup", 3 }, { 0, 0 }, { (void*)"er!", 4 } };
+      EXPECT_EQ(0, MsgReplyv(rcvid, 0, reply, 3));
+      
+      std::vector<char> in(big.size());
+      
+      rcvid = MsgReceive(chid, &in[0], in.size(), 0);
+      EXPECT_GT(rcvid, 0);
+      EXPECT_TRUE(in == big);
+      
+      EXPECT_EQ(0, MsgReply(rcvid, 0, 0, 0));
+   });
+   
+   char buf[80];   
+   strcpy(buf, "Hallo +Welt");
+   
+   struct iovec  in[3] = { { buf, 6 }, { 0, 0 }, { buf + 7, 5 } };
+   struct iovec out[3] = { { buf, 3 }, { 0, 0 }, { buf + 10, 32 } };
+   
+   EXPECT_EQ(0, MsgSendv(coid, in, 3, out, 3));
+   EXPECT_EQ(0, strncmp(buf, "Sup", 3));
+   EXPECT_EQ(0, strcmp(buf + 10, "er!"));
+   
+   struct iovec bigin[4] = { { &big[0], 4096 }, { 0, 0 }, { 0, 0 }, { &big[4096], 4096 } };
+   EXPECT_EQ(0, MsgSendv(coid, bigin, 4, 0, 0));
+   
+   t.join(); 
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
@@ -27,6 +27,25 @@ void senderthread(int chid)
    EXPECT_EQ(0, ConnectDetach(coid));
 }
 
+
+void serverthread(int chid, int num)
+{
+   const char sendbuf[] = "Super Show";
+   char recvbuf[32];
+   
+   for(int i=0; i<num; ++i)
+   {
+      // receive the header only, the rest is read while other requests are pending, too
+      int rcvid = MsgReceive(chid, recvbuf, 4, 0);
+      EXPECT_GT(rcvid, 0);
+      
+      EXPECT_EQ(7, MsgRead(rcvid, recvbuf + 4, sizeof(recvbuf) - 4, 4));
+      EXPECT_EQ(0, strcmp(recvbuf, "Hallo Welt"));
+      
+      EXPECT_EQ(0, MsgReply(rcvid, 0, sendbuf, sizeof(sendbuf)));
+   }
+}
+
 }
 
 
@@ -64,3 +83,29 @@ TEST(qnxcomm, multithreaded)
    
    EXPECT_EQ(0, ChannelDestroy(chid));
 }
+
+
+TEST(qnxcomm, multithreaded_server) 
+{
+   int i;
+   
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+
+   std::thread senders[NUM_THREADS];
+   std::thread servers[NUM_THREADS];
+   
+   for (i=0 ; i<NUM_THREADS; ++i)
+   {
+      senders[i] = std::move(std::thread(&senderthread, chid));
+      servers[i] = std::move(std::thread(&serverthread, chid, NUM_REQUESTS));
+   }
+   
+   for (i=0 ; i<NUM_THREADS; ++i)
+   {
+      senders[i].join();
+      servers[i].join();
+   }
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
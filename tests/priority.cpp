@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <pthread.h>
+#include <atomic>
+#include <iostream>
+
+#include "qnxcomm.h"
+
+
+TEST(Priority, pulses) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   EXPECT_EQ(0, MsgSendNoReply(coid, "low", 4));
+   EXPECT_EQ(0, MsgSendPulse(coid, 5, 1, 1));
+   EXPECT_EQ(0, MsgSendPulse(coid, 20, 1, 2));
+   EXPECT_EQ(0, MsgSendPulse(coid, 5, 1, 3));
+   EXPECT_EQ(0, MsgSendPulse(coid, 20, 1, 4));
+   
+   // clamped to the highest priority
+   EXPECT_EQ(0, MsgSendPulse(coid, 255, 1, 5));
+   
+   // highest priority first, FIFO within a priority
+   const int values[] = { 5, 2, 4, 1, 3 };
+   const int priorities[] = { 99, 20, 20, 5, 5 };
+   
+   char buf[80];
+   struct _msg_info info;
+   
+   for (int i=0; i<5; ++i)
+   {
+      EXPECT_EQ(0, MsgReceive(chid, buf, sizeof(buf), &info));
+      EXPECT_EQ(values[i], ((struct _pulse*)buf)->value.sival_int);
+      EXPECT_EQ(priorities[i], info.priority);
+   }
+   
+   // normal threads send with priority 0
+   EXPECT_GT(MsgReceive(chid, buf, sizeof(buf), &info), 0);
+   EXPECT_EQ(0, strcmp(buf, "low"));
+   EXPECT_EQ(0, info.priority);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+TEST(Priority, realtime_sender) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   std::thread normal([coid]() {
+      EXPECT_EQ(0, MsgSend(coid, "normal", 7, 0, 0));
+   });
+   
+   usleep(50000);
+   
+   std::thread rt([coid]() {
+      struct sched_param param = { 0 };
+      param.sched_priority = 30;
+      
+      // the receiver tells from the priority whether this worked
+      (void)pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      
+      EXPECT_EQ(0, MsgSend(coid, "realtime", 9, 0, 0));
+   });
+   
+   usleep(50000);
+   
+   char buf[80];
+   struct _msg_info info;
+   
+   int rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_GT(rcvid, 0);
+   
+   if (info.priority == 30)
+   {
+      EXPECT_EQ(0, strcmp(buf, "realtime"));
+   }
+   else
+      EXPECT_EQ(0, strcmp(buf, "normal"));
+      
+   EXPECT_EQ(0, MsgReply(rcvid, 0, 0, 0));
+   
+   rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_EQ(0, MsgReply(rcvid, 0, 0, 0));
+   
+   normal.join();
+   rt.join();
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+namespace {
+
+uint64_t now_ns(clockid_t clock)
+{
+   struct timespec ts;
+   clock_gettime(clock, &ts);
+   
+   return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+void pin_to_cpu0(pthread_t thread)
+{
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(0, &set);
+   
+   EXPECT_EQ(0, pthread_setaffinity_np(thread, sizeof(set), &set));
+}
+
+
+/**
+ * A SCHED_FIFO client (the calling thread, priority 20, pinned to cpu 0) sends to 
+ * a SCHED_OTHER server while a SCHED_FIFO hog (priority 10) spins on the same cpu 
+ * as soon as the server started working. Returns the round trip time in ms.
+ */
+uint64_t contended_round_trip(unsigned flags)
+{
+   int chid = ChannelCreate(flags);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   std::atomic<bool> received(false);
+   
+   std::thread server([chid, &received]() {
+      // threads inherit the creator's policy
+      struct sched_param param = { 0 };
+      EXPECT_EQ(0, pthread_setschedparam(pthread_self(), SCHED_OTHER, &param));
+      
+      char buf[16];
+      int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+      EXPECT_GT(rcvid, 0);
+      
+      received = true;
+      
+      // 10ms of real work
+      uint64_t start = now_ns(CLOCK_THREAD_CPUTIME_ID);
+      while (now_ns(CLOCK_THREAD_CPUTIME_ID) - start < 10000000ull);
+      
+      EXPECT_EQ(0, MsgReply(rcvid, 0, 0, 0));
+   });
+   
+   std::thread hog([&received]() {
+      struct sched_param param = { 0 };
+      param.sched_priority = 10;
+      EXPECT_EQ(0, pthread_setschedparam(pthread_self(), SCHED_FIFO, &param));
+      
+      while (!received)
+         usleep(100);
+         
+      uint64_t start = now_ns(CLOCK_MONOTONIC);
+      while (now_ns(CLOCK_MONOTONIC) - start < 300000000ull);
+   });
+   
+   // everybody is ready and sleeping
+   usleep(50000);
+   
+   uint64_t start = now_ns(CLOCK_MONOTONIC);
+   EXPECT_EQ(0, MsgSend(coid, "work", 5, 0, 0));
+   uint64_t elapsed = now_ns(CLOCK_MONOTONIC) - start;
+   
+   server.join();
+   hog.join();
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   
+   return elapsed / 1000000;
+}
+
+}
+
+
+TEST(Priority, inheritance_latency) 
+{
+   int policy;
+   struct sched_param saved;
+   ASSERT_EQ(0, pthread_getschedparam(pthread_self(), &policy, &saved));
+   
+   cpu_set_t saved_cpus;
+   ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(saved_cpus), &saved_cpus));
+   
+   struct sched_param param = { 0 };
+   param.sched_priority = 20;
+   
+   if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+      GTEST_SKIP() << "SCHED_FIFO not permitted";
+      
+   pin_to_cpu0(pthread_self());
+   
+   uint64_t inverted = contended_round_trip(0);
+   uint64_t inherited = contended_round_trip(QNX_CHF_PRIO_INHERIT);
+   
+   std::cout << "round trip under contention: " << inverted << "ms without, " 
+             << inherited << "ms with priority inheritance" << std::endl;
+   
+   // the hog spins for 300ms, the boosted server preempts it
+   EXPECT_LT(inherited, 100u);
+   
+   EXPECT_EQ(0, pthread_setschedparam(pthread_self(), policy, &saved));
+   EXPECT_EQ(0, pthread_setaffinity_np(pthread_self(), sizeof(saved_cpus), &saved_cpus));
+}
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <vector>
 
 #include "qnxcomm.h"
 
@@ -37,3 +38,32 @@ TEST(qnxcomm, setup_invalid)
    EXPECT_EQ(-1, ConnectDetach(9978));
    EXPECT_EQ(EINVAL, errno);
 }
+
+
+TEST(qnxcomm, many_channels) 
+{
+   const int num = 2000;
+   std::vector<int> chids;
+   
+   for (int i=0; i<num; ++i)
+   {
+      int chid = ChannelCreate(0);
+      EXPECT_GT(chid, 0);
+      
+      chids.push_back(chid);
+   }
+   
+   int coid = ConnectAttach(0, 0, chids.back(), 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, 42));
+   
+   struct _pulse pulse;
+   EXPECT_EQ(0, MsgReceive(chids.back(), &pulse, sizeof(pulse), 0));
+   EXPECT_EQ(42, pulse.value.sival_int);
+   
+   EXPECT_EQ(0, ConnectDetach(coid));
+   
+   for (int i=0; i<num; ++i)
+      EXPECT_EQ(0, ChannelDestroy(chids[i]));
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <poll.h>
+
+#include "qnxcomm.h"
+
+
+namespace {
+
+void receiverthread(int chid)
+{
+   char buf[1024];
+   struct _msg_info info;
+   
+   // ring and ioctl messages from the same sender keep their order
+   for (int i=0; i<100; ++i)
+   {
+      int rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+      EXPECT_GT(rcvid, 0);
+      EXPECT_NE(0, info.flags & QNX_FLAG_NOREPLY);
+      EXPECT_EQ(::getpid(), info.pid);
+      EXPECT_EQ(i, *(int*)buf);
+      
+      // each 10th message is too large for the ring
+      EXPECT_EQ(i % 10 == 9 ? 1000 : (int)sizeof(int), info.msglen);
+   }
+   
+   int rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_EQ(0, rcvid);
+   EXPECT_EQ(7, ((struct _pulse*)buf)->code);
+   EXPECT_EQ(4711, ((struct _pulse*)buf)->value.sival_int);
+   EXPECT_EQ(8, info.msglen);
+}
+
+}
+
+
+TEST(SubmitRing, order) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, QNX_COF_SUBMIT_RING);
+   EXPECT_GT(coid, 0);
+   
+   char buf[1000];
+   memset(buf, 0, sizeof(buf));
+   
+   // more than QNX_RING_SLOTS, so the ring gets full and flushed
+   for (int i=0; i<100; ++i)
+   {
+      *(int*)buf = i;
+      EXPECT_EQ(0, MsgSendNoReply(coid, buf, i % 10 == 9 ? 1000 : sizeof(int)));
+   }
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 7, 4711));
+   
+   std::thread t(&receiverthread, chid);
+   t.join();
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
+
+
+TEST(SubmitRing, wakeup) 
+{
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, QNX_COF_SUBMIT_RING);
+   
+   std::thread t([chid]() {
+      struct _pulse pulse;
+      
+      // blocks until the doorbell rings
+      for (int i=0; i<3; ++i)
+      {
+         EXPECT_EQ(0, MsgReceive(chid, &pulse, sizeof(pulse), 0));
+         EXPECT_EQ(i, pulse.value.sival_int);
+      }
+   });
+   
+   for (int i=0; i<3; ++i)
+   {
+      ::usleep(50000);
+      EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, i));
+   }
+   
+   t.join();
+   
+   // pollfds are woken up as well
+   int pfd = MsgReceivePollFd(chid);
+   EXPECT_GE(pfd, 0);
+   
+   struct pollfd fds = { pfd, POLLIN, 0 };
+   EXPECT_EQ(0, ::poll(&fds, 1, 10));
+   
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 1, 42));
+   EXPECT_EQ(1, ::poll(&fds, 1, 1000));
+   
+   ::close(pfd);
+   
+   EXPECT_EQ(0, ConnectDetach(coid));  
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
+
+
+TEST(SubmitRing, detach) 
+{
+   int chid = ChannelCreate(0);
+   int coid = ConnectAttach(0, 0, chid, 0, QNX_COF_SUBMIT_RING);
+   EXPECT_GT(coid, 0);
+   
+   // nobody is receiving, so everything stays in the ring
+   EXPECT_EQ(0, MsgSendNoReply(coid, "hello", 6));
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, 7, 4711));
+   
+   EXPECT_EQ(0, ConnectDetach(coid));
+   
+   char buf[64];
+   struct _msg_info info;
+   
+   int rcvid = MsgReceive(chid, buf, sizeof(buf), &info);
+   EXPECT_GT(rcvid, 0);
+   EXPECT_NE(0, info.flags & QNX_FLAG_NOREPLY);
+   EXPECT_EQ(6, info.msglen);
+   EXPECT_STREQ("hello", buf);
+   
+   EXPECT_EQ(0, MsgReceive(chid, buf, sizeof(buf), &info));
+   EXPECT_EQ(7, ((struct _pulse*)buf)->code);
+   EXPECT_EQ(4711, ((struct _pulse*)buf)->value.sival_int);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
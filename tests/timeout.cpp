@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <thread>
+#include <atomic>
 
 #include "qnxcomm.h"
 
@@ -101,3 +102,171 @@ TEST(qnxcomm, timeout)
    EXPECT_EQ(0, ConnectDetach(coid));  
 }
 
+
+
+TEST(qnxcomm, timeout_resolution) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   char buf[80];   
+   struct timespec start, end;
+   
+   uint64_t timeout = 200 * 1000ULL;
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, 0, &timeout, 0));
+   
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   
+   int rc = MsgReceive(chid, buf, sizeof(buf), 0);
+   EXPECT_EQ(-1, rc);
+   EXPECT_EQ(ETIMEDOUT, errno);
+   
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   
+   long diff_us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+   
+   EXPECT_GE(diff_us, 200);
+   EXPECT_LT(diff_us, 2000);
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
+
+
+TEST(qnxcomm, timeout_send_blocked_only) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   std::thread server([chid]() {
+      char buf[80];
+      
+      usleep(50000);
+      int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+      EXPECT_GT(rcvid, 0);
+      
+      usleep(200000);
+      EXPECT_EQ(0, MsgReply(rcvid, 42, 0, 0));
+   });
+   
+   char buf[80];   
+   strcpy(buf, "Hallo Welt");
+   
+   // the deadline expires while we are reply blocked, so it does not apply
+   uint64_t timeout = 150 * 1000*1000ULL;
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_SEND, 0, &timeout, 0));
+   
+   stop_watch w;
+   EXPECT_EQ(42, MsgSend(coid, buf, strlen(buf) + 1, buf, sizeof(buf)));
+   EXPECT_GT(w.stop(), 200);
+   
+   server.join();
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+TEST(qnxcomm, timeout_reply_blocked_only) 
+{
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   int coid = ConnectAttach(0, 0, chid, 0, 0);
+   EXPECT_GT(coid, 0);
+   
+   std::thread server([chid]() {
+      char buf[80];
+      
+      usleep(100000);
+      int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+      EXPECT_GT(rcvid, 0);
+      
+      // the sender is gone already
+      usleep(100000);
+      EXPECT_EQ(-1, MsgReply(rcvid, 42, 0, 0));
+   });
+   
+   char buf[80];   
+   strcpy(buf, "Hallo Welt");
+   
+   // the deadline already expired when the message is received
+   uint64_t timeout = 50 * 1000*1000ULL;
+   EXPECT_EQ(0, TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_REPLY, 0, &timeout, 0));
+   
+   stop_watch w;
+   EXPECT_EQ(-1, MsgSend(coid, buf, strlen(buf) + 1, buf, sizeof(buf)));
+   EXPECT_EQ(ETIMEDOUT, errno);
+   
+   int diff_ms = w.stop();
+   EXPECT_GE(diff_ms, 100);
+   EXPECT_LT(diff_ms, 150);
+   
+   server.join();
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+   EXPECT_EQ(0, ConnectDetach(coid));  
+}
+
+
+TEST(qnxcomm, timeout_while_receiving) 
+{
+   const int NUM_THREADS = 4;
+   const int NUM_REQUESTS = 500;
+   
+   int chid = ChannelCreate(0);
+   EXPECT_GT(chid, 0);
+   
+   std::atomic<bool> stop(false);
+   
+   // the senders give up at any state of their requests
+   std::thread server([chid, &stop]() {
+      char buf[80];
+      uint64_t timeout = 10 * 1000*1000ULL;
+      
+      while (!stop)
+      {
+         TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, 0, &timeout, 0);
+         
+         int rcvid = MsgReceive(chid, buf, sizeof(buf), 0);
+         if (rcvid > 0)
+            MsgReply(rcvid, 0, buf, sizeof(buf));
+      }
+   });
+   
+   std::thread senders[NUM_THREADS];
+   
+   for (int i=0; i<NUM_THREADS; ++i)
+   {
+      senders[i] = std::thread([chid]() {
+         char buf[80] = "Hallo Welt";
+         
+         int coid = ConnectAttach(0, 0, chid, 0, 0);
+         EXPECT_GT(coid, 0);
+         
+         for (int j=0; j<NUM_REQUESTS; ++j)
+         {
+            uint64_t timeout = 20 * 1000ULL;
+            TimerTimeout(CLOCK_MONOTONIC, 0, 0, &timeout, 0);
+            
+            int rc = MsgSend(coid, buf, sizeof(buf), buf, sizeof(buf));
+            if (rc < 0)
+               EXPECT_EQ(ETIMEDOUT, errno);
+            else
+               EXPECT_EQ(0, rc);
+         }
+         
+         EXPECT_EQ(0, ConnectDetach(coid));
+      });
+   }
+   
+   for (int i=0; i<NUM_THREADS; ++i)
+      senders[i].join();
+   
+   stop = true;
+   server.join();
+   
+   EXPECT_EQ(0, ChannelDestroy(chid));
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#include "qnxcomm.h"
+
+
+namespace {
+
+const int CODE_WORK = 1;
+const int CODE_STOP = 2;
+
+
+/// receives pulses until told to stop, records who got which pulse
+struct Pool
+{
+   int chid;
+
+   std::mutex lock;
+   std::vector<int> served;   ///< receiver index by pulse
+   int errors;
+
+   std::vector<std::thread> threads;
+
+
+   explicit
+   Pool(unsigned flags)
+    : chid(ChannelCreate(flags))
+    , errors(0)
+   {
+      // nothing
+   }
+
+
+   void start(int idx)
+   {
+      threads.push_back(std::thread([this, idx]() {
+         struct _pulse pulse;
+
+         for(;;)
+         {
+            int rc = MsgReceive(chid, &pulse, sizeof(pulse), 0);
+
+            std::lock_guard<std::mutex> guard(lock);
+
+            if (rc != 0)
+            {
+               ++errors;
+               break;
+            }
+
+            if (pulse.code == CODE_STOP)
+               break;
+
+            served.push_back(idx);
+         }
+      }));
+
+      // give it the time to become idle
+      usleep(50000);
+   }
+
+
+   void stop(int coid)
+   {
+      for (size_t i=0; i<threads.size(); ++i)
+         EXPECT_EQ(0, MsgSendPulse(coid, 0, CODE_STOP, 0));
+
+      for (size_t i=0; i<threads.size(); ++i)
+         threads[i].join();
+
+      EXPECT_EQ(0, errors);
+      EXPECT_EQ(0, ChannelDestroy(chid));
+   }
+
+
+   int last()
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      return served.empty() ? -1 : served.back();
+   }
+};
+
+}
+
+
+TEST(Wakeup, no_spurious_timeouts)
+{
+   const int NUM_THREADS = 16;
+   const int NUM_PULSES = 4000;
+
+   Pool pool(0);
+   EXPECT_GT(pool.chid, 0);
+
+   int coid = ConnectAttach(0, 0, pool.chid, 0, 0);
+   EXPECT_GT(coid, 0);
+
+   for (int i=0; i<NUM_THREADS; ++i)
+      pool.start(i);
+
+   for (int i=0; i<NUM_PULSES; ++i)
+      EXPECT_EQ(0, MsgSendPulse(coid, 0, CODE_WORK, i));
+
+   pool.stop(coid);
+
+   // no receiver returned without a pulse
+   EXPECT_EQ(NUM_PULSES, (int)pool.served.size());
+
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
+
+
+TEST(Wakeup, fifo)
+{
+   Pool pool(0);
+   EXPECT_GT(pool.chid, 0);
+
+   int coid = ConnectAttach(0, 0, pool.chid, 0, 0);
+   EXPECT_GT(coid, 0);
+
+   pool.start(0);
+   pool.start(1);
+
+   // the thread idle for the longest time
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, CODE_WORK, 0));
+   usleep(50000);
+   EXPECT_EQ(0, pool.last());
+
+   EXPECT_EQ(0, MsgSendPulse(coid, 0, CODE_WORK, 0));
+   usleep(50000);
+   EXPECT_EQ(1, pool.last());
+
+   pool.stop(coid);
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
+
+
+TEST(Wakeup, lifo)
+{
+   Pool pool(QNX_CHF_WAKE_LIFO);
+   EXPECT_GT(pool.chid, 0);
+
+   int coid = ConnectAttach(0, 0, pool.chid, 0, 0);
+   EXPECT_GT(coid, 0);
+
+   pool.start(0);
+   pool.start(1);
+
+   // the most recently idle thread, again and again
+   for (int i=0; i<3; ++i)
+   {
+      EXPECT_EQ(0, MsgSendPulse(coid, 0, CODE_WORK, 0));
+      usleep(50000);
+      EXPECT_EQ(1, pool.last());
+   }
+
+   pool.stop(coid);
+   EXPECT_EQ(0, ConnectDetach(coid));
+}
+
+
+TEST(Wakeup, sticky)
+{
+   Pool pool(QNX_CHF_WAKE_STICKY);
+   EXPECT_GT(pool.chid, 0);
+
+   int coid1 = ConnectAttach(0, 0, pool.chid, 0, 0);
+   EXPECT_GT(coid1, 0);
+
+   int coid2 = ConnectAttach(0, 0, pool.chid, 0, 0);
+   EXPECT_GT(coid2, 0);
+
+   pool.start(0);
+   pool.start(1);
+
+   // unknown connections fall back to FIFO
+   EXPECT_EQ(0, MsgSendPulse(coid1, 0, CODE_WORK, 0));
+   usleep(50000);
+   EXPECT_EQ(0, pool.last());
+
+   EXPECT_EQ(0, MsgSendPulse(coid2, 0, CODE_WORK, 0));
+   usleep(50000);
+   EXPECT_EQ(1, pool.last());
+
+   // FIFO would alternate between the threads
+   for (int i=0; i<3; ++i)
+   {
+      EXPECT_EQ(0, MsgSendPulse(coid1, 0, CODE_WORK, 0));
+      usleep(50000);
+      EXPECT_EQ(0, pool.last());
+   }
+
+   for (int i=0; i<3; ++i)
+   {
+      EXPECT_EQ(0, MsgSendPulse(coid2, 0, CODE_WORK, 0));
+      usleep(50000);
+      EXPECT_EQ(1, pool.last());
+   }
+
+   pool.stop(coid1);
+
+   EXPECT_EQ(0, ConnectDetach(coid1));
+   EXPECT_EQ(0, ConnectDetach(coid2));
+}
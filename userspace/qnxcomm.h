@@ -15,6 +15,41 @@ extern "C" {
 #define _NTO_SIDE_CHANNEL ((int)((~0u ^ (~0u >> 1)) >> 1))
 #define QNX_FLAG_NOREPLY    0x1
 
+/// ChannelCreate flag: noreply messages are stored in preallocated memory (see kernel module parameters)
+#define QNX_CHF_NOREPLY_POOL   0x00010000
+
+/**
+ * ChannelCreate flag: MsgReceive raises the receiving thread to the (realtime)
+ * priority of the client it took a message from (SCHED_FIFO), MsgReply and
+ * MsgError restore it. A thread serving several clients keeps the highest 
+ * priority until it replied to all of them. Threads are never lowered.
+ */
+#define QNX_CHF_PRIO_INHERIT   0x00020000
+
+/**
+ * ChannelCreate flags selecting which idle MsgReceive thread a message wakes
+ * up, only a single one is woken per message. By default it is the thread 
+ * idle for the longest time (FIFO). QNX_CHF_WAKE_LIFO takes the most recently
+ * idle thread, whose cache is still hot. QNX_CHF_WAKE_STICKY prefers the 
+ * thread which received from the sending connection last, if that one is 
+ * idle, and falls back to FIFO or LIFO otherwise.
+ */
+#define QNX_CHF_WAKE_LIFO      0x00040000
+#define QNX_CHF_WAKE_STICKY    0x00080000
+
+/**
+ * ChannelCreate flag: a pulse still queued on the channel with the same 
+ * connection, code and priority is updated to the new value instead of 
+ * queueing another one, i.e. the receiver gets the latest value once.
+ */
+#define QNX_CHF_COALESCE_PULSES   0x00100000
+
+/// ConnectAttach flag: small noreply messages and pulses are passed to the kernel without a system call
+#define QNX_COF_SUBMIT_RING    0x00010000
+
+/// ConnectAttach flag: MsgSendNoReply(v) fails with EAGAIN instead of blocking if the channel is full
+#define QNX_COF_NONBLOCK       0x00020000
+
 struct _msg_info 
 {
    uint32_t  nd;         ///< client node address, always 0    
@@ -26,7 +61,7 @@ struct _msg_info
    int32_t   msglen;     ///< equal to srcmsglen
    int32_t   srcmsglen;  ///< length of MsgSend input data
    int32_t   dstmsglen;  ///< length of MsgSend output data
-   int16_t   priority;   ///< priority of message, i.e. thread priority or pulse priority (TODO currently unset)
+   int16_t   priority;   ///< priority of message, i.e. the sender's realtime priority (0 for normal threads) or pulse priority
    int16_t   flags;      ///< may have the flag QNX_FLAG_NOREPLY set
    uint32_t  reserved;   ///< unused
 };
@@ -43,6 +78,25 @@ struct _pulse
 };
 
 
+/// entry for MsgSendPulseBatch
+struct _pulse_batch
+{
+   int coid;
+   int priority;   ///< as for MsgSendPulse
+   int code;
+   int value;
+};
+
+
+/// entry for MsgSendNoReplyBatch
+struct _noreply_batch
+{
+   int coid;
+   const void* smsg;
+   int sbytes;
+};
+
+
 int ChannelCreate(unsigned flags);
 
 int ChannelDestroy(int chid);
@@ -56,11 +110,29 @@ int MsgSend(int coid, const void* smsg, int sbytes, void* rmsg, int rbytes);
 
 int MsgSendv(int coid, const struct iovec* siov, int sparts, const struct iovec* riov, int rparts);
 
+/**
+ * Pulses are received before messages of lower priority. The priority
+ * ranges from 0 to 99 (larger values are clamped), -1 selects the calling 
+ * thread's realtime priority as used for MsgSend.
+ * Fails with EAGAIN if the channel already has the number of pulses 
+ * queued given by the kernel module parameter @c pulses_per_channel.
+ */
 int MsgSendPulse(int coid, int priority, int code, int value);
 
 
+/**
+ * Messages and pulses are received highest priority first, in the order
+ * they were sent within a priority. Messages have the sending thread's
+ * realtime priority (SCHED_FIFO or SCHED_RR), 0 for normal threads.
+ */
 int MsgReceive(int chid, void* msg, int bytes, struct _msg_info* info);
 
+/**
+ * Receives pulses only, in the same order as MsgReceive. Messages stay 
+ * queued for the other receivers of the channel. Returns 0 on success.
+ */
+int MsgReceivePulse(int chid, void* pulse, int bytes, struct _msg_info* info);
+
 int MsgRead(int rcvid, void* msg, int bytes, int offset);
 
 int MsgReply(int rcvid, int status, const void* msg, int size);
@@ -68,19 +140,41 @@ int MsgReply(int rcvid, int status, const void* msg, int size);
 int MsgError(int rcvid, int error);
 
 
-// TODO so far unimplemented
+/**
+ * Vectored versions of the above, the data is copied directly between 
+ * the sender and the given iovec without an intermediate buffer.
+ */
 int MsgReceivev(int chid, const struct iovec* riov, int rparts, struct _msg_info* info);
 
 int MsgReadv(int rcvid, const struct iovec* riov, int rparts, int offset);
 
-int MsgWrite(int rcvid, const void* msg, int size, int offset);
-
 int MsgReplyv(int rcvid, int status, const struct iovec* riov, int rparts);
 
-int MsgReceivePulse(int chid, void * pulse, int bytes, struct _msg_info * info);
+
+// TODO so far unimplemented
+int MsgWrite(int rcvid, const void* msg, int size, int offset);
 
 
 // timeout support
+#define _NTO_TIMEOUT_SEND      0x10
+#define _NTO_TIMEOUT_RECEIVE   0x20
+#define _NTO_TIMEOUT_REPLY     0x40
+
+#ifndef SIGEV_UNBLOCK
+#   define SIGEV_UNBLOCK       5
+#   define SIGEV_UNBLOCK_INIT(__e) ((__e)->sigev_notify = SIGEV_UNBLOCK)
+#endif
+
+/**
+ * Sets a timeout for the next blocking call of the calling thread. The call
+ * fails with ETIMEDOUT once the deadline has expired in one of the blocking 
+ * states given in @c flags (_NTO_TIMEOUT_SEND: queued by MsgSend(v), 
+ * _NTO_TIMEOUT_REPLY: received but not yet replied, _NTO_TIMEOUT_RECEIVE: 
+ * MsgReceive waiting for a message). Without any state flag the timeout 
+ * applies to all states. @c ntime is relative in nanoseconds unless 
+ * TIMER_ABSTIME is set in @c flags. Only CLOCK_MONOTONIC is supported,
+ * @c notify must be 0 or a SIGEV_UNBLOCK event.
+ */
 int TimerTimeout(clockid_t id, int flags, const struct sigevent * notify, const uint64_t * ntime, uint64_t * otime);
 
 
@@ -105,28 +199,82 @@ int ConnectAttachEx(uint32_t nd, pid_t pid, int chid, unsigned index, int flags,
  * Send message but don't wait for reply.
  * The maximum size for the message is defined by the kernel module 
  * parameter @c noreply_max_size [bytes].
- * The function may block if no more internal slots are available which
- * is configurable by the module parameter @c noreply_per_channel [#messages].
+ * The function blocks until a receiver frees a slot if no more internal 
+ * slots are available which is configurable by the module parameter 
+ * @c noreply_per_channel [#messages]. A _NTO_TIMEOUT_SEND TimerTimeout
+ * limits the wait (ETIMEDOUT), on connections attached with 
+ * QNX_COF_NONBLOCK the function fails with EAGAIN instead.
  * You must not reply on such a message via MsgReply, nor can you
  * read more data after calling MsgReceive. A NoReply message can be
  * detected from MsgReceive via the _msg_info structure flags 
  * (QNX_FLAG_NOREPLY is set).
+ * On connections attached with QNX_COF_SUBMIT_RING, messages up to 
+ * 128 bytes (and pulses) are usually passed without a system call. 
+ * In that case a vanished receiver is not reported and the message is
+ * queued with priority 0. Messages still in the ring are delivered when
+ * the connection is detached or the sender exits.
  */
 int MsgSendNoReply(int coid, const void* smsg, int sbytes);
 
 /**
- * Send message but don't wait for reply.
- * The maximum size for the message is defined by the kernel module 
- * parameter @c noreply_max_size [bytes].
- * The function may block if no more internal slots are available which
- * is configurable by the module parameter @c noreply_per_channel [#messages].
- * You must not reply on such a message via MsgReply, nor can you
- * read more data after calling MsgReceive. A NoReply message can be
- * detected from MsgReceive via the _msg_info structure flags 
- * (QNX_FLAG_NOREPLY is set).
+ * Vectored version of MsgSendNoReply, blocks the same way.
  */
 int MsgSendNoReplyv(int coid, const struct iovec* siov, int sparts);
 
+/**
+ * Send many pulses with a single transition into the kernel. Pulses to 
+ * the same channel keep their order. Returns the number of pulses sent,
+ * which is less than @c num if an entry failed (the entries before
+ * have been sent), or -1 if the first entry failed.
+ */
+int MsgSendPulseBatch(const struct _pulse_batch* pulses, int num);
+
+/**
+ * Batch version of MsgSendNoReply, same return values as MsgSendPulseBatch.
+ * The entries blocking for space are covered by a TimerTimeout given for
+ * the send blocked state, the entries before are sent before blocking.
+ */
+int MsgSendNoReplyBatch(const struct _noreply_batch* msgs, int num);
+
+/**
+ * Arms a one-shot pulse (@c code, @c value) sent to @c notify_coid once
+ * the noreply messages waiting on the channel behind @c coid drop below 
+ * the module parameter @c noreply_low_watermark (default: half of 
+ * @c noreply_per_channel). The pulse is sent immediately if the queue
+ * already is below. Meant for QNX_COF_NONBLOCK producers which got EAGAIN.
+ */
+int MsgNoReplyNotify(int coid, int notify_coid, int code, int value);
+
+/**
+ * Receive as many pulses and noreply messages as fit into @c msg, but at 
+ * most @c max. Each message gets its own entry in @c infos, noreply 
+ * messages have QNX_FLAG_NOREPLY set. The messages are stored one after 
+ * another, use MsgReceiveBatchNext to get the offset of the next message. 
+ * Pulses are stored as struct _pulse. The first message is truncated 
+ * if the buffer is too small.
+ * Returns the number of messages received. 0 is returned if the next 
+ * message needs a reply, use MsgReceive to receive it.
+ */
+int MsgReceiveBatch(int chid, void* msg, int bytes, struct _msg_info* infos, int max);
+
+static inline
+int MsgReceiveBatchNext(int offset, const struct _msg_info* info)
+{
+   int len = (info->flags & QNX_FLAG_NOREPLY) ? info->msglen : (int)sizeof(struct _pulse);
+   return (offset + len + 7) & ~7;
+}
+
+/**
+ * MsgReply on @c rcvid followed by MsgReceive on @c chid within a single
+ * system call, which is the usual server loop. The reply is skipped if
+ * @c rcvid is not greater than 0 (i.e. the first loop iteration or after 
+ * receiving a pulse or noreply message). If the reply fails or @c chid is
+ * invalid, -1 is returned and nothing is received. Otherwise the return 
+ * values are as for MsgReceive. If no further message is waiting, the 
+ * replied client is woken up on the current cpu.
+ */
+int MsgReplyReceive(int rcvid, int status, const void* rmsg, int rbytes, int chid, void* msg, int bytes, struct _msg_info* info);
+
 /**
  * Return a file descriptor to be used for polling for new messages
  * using select, poll or epoll. The fd may NOT be used to retrieve data,
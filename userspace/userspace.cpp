@@ -2,6 +2,7 @@
 
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -9,8 +10,10 @@
 #include <string.h>
 #include <time.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <limits>
 #include <mutex>
+#include <atomic>
 
 #include "qnxcomm.h"
 #include "../kernel/qnxcomm_driver.h"
@@ -26,6 +29,8 @@ int initialize()
 static int fd = initialize();
 std::mutex mtx;
 
+void forget_rings();
+
 
 template<typename DataT>
 int safe_ioctl(int cmd, DataT data)
@@ -43,6 +48,9 @@ int safe_ioctl(int cmd, DataT data)
                   
          while(close(fd) && errno == EINTR);
          fd = initialize();
+         
+         // the mappings belong to the old file, nobody consumes them any more
+         forget_rings();
       }
       else
          break;
@@ -55,9 +63,10 @@ int safe_ioctl(int cmd, DataT data)
 struct timeout_val
 {
    inline
-   void set(uint64_t the_ntime, uint64_t* the_otime)
+   void set(uint64_t the_deadline, int the_flags, uint64_t* the_otime)
    {
-      ntime = the_ntime;
+      timeout.deadline = the_deadline;
+      timeout.flags = the_flags;
       otime = the_otime;
    }
 
@@ -67,17 +76,119 @@ struct timeout_val
       if (otime != 0)
          *otime = 0;
 
-      ntime = UINT64_MAX;
+      timeout.flags = 0;
       otime = 0;
    }
 
-   uint64_t  ntime;
+   qnx_io_timeout timeout;
    uint64_t* otime;
 };
 
 
-// timeout in nanoseconds for next qnxcomm "system call" stored in TLS entry
-__thread timeout_val sTimerTimeout = { UINT64_MAX, 0 };
+// absolute deadline for next qnxcomm "system call" stored in TLS entry
+__thread timeout_val sTimerTimeout = { { UINT64_MAX, 0 }, 0 };
+
+
+/// sender side of a connection's submission ring
+struct submit_ring
+{
+   std::mutex mtx;          ///< serializes the sending threads
+   qnx_ring_header* hdr;
+};
+
+
+/// connections with a coid beyond this always use the ioctl interface
+const int MAX_RING_COIDS = 1024;
+
+std::atomic<submit_ring*> rings[MAX_RING_COIDS];
+
+
+/// the mappings are not inherited by a forked child, see kernel module, 
+/// and are stale after a reconnect. They are leaked since another thread 
+/// may still be submitting to them.
+void forget_rings()
+{
+   for (int i=0; i<MAX_RING_COIDS; ++i)
+      rings[i].store(0, std::memory_order_relaxed);
+}
+
+int ring_atfork = pthread_atfork(0, 0, &forget_rings);
+
+
+void attach_ring(int coid)
+{
+   if (coid >= MAX_RING_COIDS)
+      return;
+   
+   void* mem = ::mmap(0, sizeof(qnx_ring_header), PROT_READ|PROT_WRITE, MAP_SHARED, fd, (off_t)coid * ::sysconf(_SC_PAGESIZE));
+   
+   // without the ring the connection still works via ioctl
+   if (mem != MAP_FAILED)
+   {
+      submit_ring* ring = new submit_ring;
+      ring->hdr = static_cast<qnx_ring_header*>(mem);
+      
+      rings[coid].store(ring, std::memory_order_release);
+   }
+}
+
+
+void detach_ring(int coid)
+{
+   if (coid < MAX_RING_COIDS)
+   {
+      submit_ring* ring = rings[coid].exchange(0);
+      
+      if (ring)
+      {
+         ::munmap(ring->hdr, sizeof(qnx_ring_header));
+         delete ring;
+      }
+   }
+}
+
+
+/**
+ * @return false if the message must be sent via ioctl, i.e. if there 
+ *         is no ring or the ring is full.
+ */
+bool ring_submit(int coid, int type, int priority, int code, int value, const void* data, int len)
+{
+   submit_ring* ring = coid >= 0 && coid < MAX_RING_COIDS ? rings[coid].load(std::memory_order_acquire) : 0;
+   
+   if (!ring || len < 0 || len > QNX_SMALL_MSG_SIZE)
+      return false;
+      
+   {
+      std::lock_guard<std::mutex> guard(ring->mtx);
+      
+      uint32_t tail = ring->hdr->tail;
+      
+      if (tail - __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE) >= QNX_RING_SLOTS)
+         return false;
+         
+      qnx_ring_slot* slot = &ring->hdr->slots[tail & (QNX_RING_SLOTS - 1)];
+      
+      slot->type = type;
+      slot->priority = priority;
+      slot->code = code;
+      slot->value = value;
+      slot->len = len;
+      
+      if (len > 0)
+         memcpy(slot->data, data, len);
+      
+      __atomic_store_n(&ring->hdr->tail, tail + 1, __ATOMIC_RELEASE);
+   }
+   
+   // pairs with the kernel's barrier between setting need_wakeup and reading tail
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   
+   if (__atomic_load_n(&ring->hdr->need_wakeup, __ATOMIC_RELAXED))
+      ::ioctl(fd, QNX_IO_RING_DOORBELL, coid);
+      
+   return true;
+}
 
 
 struct TimerStackSafe
@@ -89,10 +200,9 @@ struct TimerStackSafe
    }
    
    inline
-   int get_timeout_ms()
+   qnx_io_timeout get_timeout()
    {
-      uint64_t rc = sTimerTimeout.ntime / 1000000;
-      return rc > std::numeric_limits<int>::max() ? -1 : rc;      
+      return sTimerTimeout.timeout;
    }
 };
 
@@ -102,28 +212,32 @@ struct TimerStackSafe
 extern "C"
 int TimerTimeout(clockid_t id, int flags, const struct sigevent * notify, const uint64_t * ntime, uint64_t * otime)
 {      
-   if (!ntime || id != CLOCK_MONOTONIC)
+   if (!ntime || id != CLOCK_MONOTONIC || (notify && notify->sigev_notify != SIGEV_UNBLOCK))
    {
       errno = EINVAL;
       return -1;
    }
 
-   uint64_t timeout = *ntime;      
+   // the kernel gets an absolute deadline, so an interrupted and restarted call keeps it
+   uint64_t deadline = *ntime;      
 
-   if (flags & TIMER_ABSTIME)
+   if (!(flags & TIMER_ABSTIME))
    {      
       struct timespec ts;
       ::clock_gettime(CLOCK_MONOTONIC, &ts); 
       
       uint64_t now = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
 
-      if (now > timeout)
-         timeout = 0;
-      else
-         timeout -= now;
+      deadline = deadline > UINT64_MAX - now ? UINT64_MAX : deadline + now;
    }
+   
+   int states = flags & (_NTO_TIMEOUT_SEND | _NTO_TIMEOUT_RECEIVE | _NTO_TIMEOUT_REPLY);
+   
+   // compatibility: without any state the timeout applies to all of them
+   if (states == 0)
+      states = _NTO_TIMEOUT_SEND | _NTO_TIMEOUT_RECEIVE | _NTO_TIMEOUT_REPLY;
       
-   sTimerTimeout.set(timeout, otime);         
+   sTimerTimeout.set(deadline, states, otime);         
    return 0;
 }
 
@@ -183,6 +297,9 @@ int ConnectAttach(uint32_t nd, pid_t pid, int chid, unsigned index, int flags)
                   
          rc = safe_ioctl(QNX_IO_CONNECTATTACH, &data);
          
+         if (rc > 0 && (flags & QNX_COF_SUBMIT_RING))
+            attach_ring(rc);
+         
          if (rc > 0 && (index & _NTO_SIDE_CHANNEL))
             rc |= _NTO_SIDE_CHANNEL;
       }
@@ -203,6 +320,7 @@ int ConnectDetach(int coid)
     
    if (fd >= 0)
    {
+      detach_ring(coid & ~_NTO_SIDE_CHANNEL);
       rc = safe_ioctl(QNX_IO_CONNECTDETACH, coid & ~_NTO_SIDE_CHANNEL);
    }
    else
@@ -223,7 +341,8 @@ int MsgSend(int coid, const void* smsg, int sbytes, void* rmsg, int rbytes)
    if (fd >= 0)
    {
       TimerStackSafe ttsf;
-      struct qnx_io_msgsend io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout_ms(), { const_cast<void*>(smsg), (size_t)sbytes }, { rmsg, (size_t)rbytes } };
+      
+      struct qnx_io_msgsend io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout(), { const_cast<void*>(smsg), (size_t)sbytes }, { rmsg, (size_t)rbytes } };
       rc = safe_ioctl(QNX_IO_MSGSEND, &io);
    }
    else
@@ -234,13 +353,17 @@ int MsgSend(int coid, const void* smsg, int sbytes, void* rmsg, int rbytes)
 
 
 extern "C" 
-int MsgSendPulse(int coid, int /*priority*/, int code, int value)
+int MsgSendPulse(int coid, int priority, int code, int value)
 {
    int rc = -1;
    
    if (fd >= 0)
    {
-      struct qnx_io_msgsendpulse io = { coid & ~_NTO_SIDE_CHANNEL, code, value };
+      // only the kernel knows the calling thread's priority
+      if (priority >= 0 && ring_submit(coid & ~_NTO_SIDE_CHANNEL, QNX_RING_PULSE, priority, code, value, 0, 0))
+         return 0;
+         
+      struct qnx_io_msgsendpulse io = { coid & ~_NTO_SIDE_CHANNEL, priority, code, value };
       rc = safe_ioctl(QNX_IO_MSGSENDPULSE, &io);
    }
    else
@@ -261,7 +384,7 @@ int MsgReceive(int chid, void* msg, int bytes, struct _msg_info* info)
    if (fd >= 0)
    {
       TimerStackSafe ttsf;
-      struct qnx_io_receive io = { chid, ttsf.get_timeout_ms(), { msg, (size_t)bytes }, { 0 } };      
+      struct qnx_io_receive io = { chid, ttsf.get_timeout(), { msg, (size_t)bytes }, { 0 } };      
       rc = safe_ioctl(QNX_IO_MSGRECEIVE, &io);
       
       if (rc >= 0 && info)      
@@ -274,6 +397,45 @@ int MsgReceive(int chid, void* msg, int bytes, struct _msg_info* info)
 }
 
 
+extern "C" 
+int MsgReceivePulse(int chid, void* pulse, int bytes, struct _msg_info* info)
+{
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      TimerStackSafe ttsf;
+      struct qnx_io_receive io = { chid, ttsf.get_timeout(), { pulse, (size_t)bytes }, { 0 } };      
+      rc = safe_ioctl(QNX_IO_MSGRECEIVEPULSE, &io);
+      
+      if (rc >= 0 && info)      
+         memcpy(info, &io.info, sizeof(struct _msg_info));      
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
+}
+
+
+extern "C" 
+int MsgReceiveBatch(int chid, void* msg, int bytes, struct _msg_info* infos, int max)
+{
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      TimerStackSafe ttsf;
+      struct qnx_io_receive_batch io = { chid, ttsf.get_timeout(), { msg, (size_t)bytes }, infos, max };      
+      rc = safe_ioctl(QNX_IO_MSGRECEIVE_BATCH, &io);
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
+}
+
+
 extern "C" 
 int MsgReply(int rcvid, int status, const void* msg, int size)
 {
@@ -291,6 +453,30 @@ int MsgReply(int rcvid, int status, const void* msg, int size)
 }
 
 
+extern "C" 
+int MsgReplyReceive(int rcvid, int status, const void* rmsg, int rbytes, int chid, void* msg, int bytes, struct _msg_info* info)
+{
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      TimerStackSafe ttsf;
+      struct qnx_io_replyreceive io = { 
+         { rcvid, status, { const_cast<void*>(rmsg), (size_t)rbytes } }, 
+         { chid, ttsf.get_timeout(), { msg, (size_t)bytes }, { 0 } } 
+      };
+      rc = safe_ioctl(QNX_IO_MSGREPLYRECEIVE, &io);
+      
+      if (rc >= 0 && info)      
+         memcpy(info, &io.receive.info, sizeof(struct _msg_info));      
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
+}
+
+
 extern "C" 
 int MsgError(int rcvid, int error)
 {
@@ -336,7 +522,7 @@ int MsgSendv(int coid, const struct iovec* siov, int sparts, const struct iovec*
    if (fd >= 0)
    {
       TimerStackSafe ttsf;
-      struct qnx_io_msgsendv io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout_ms(), const_cast<struct iovec*>(siov), sparts, const_cast<struct iovec*>(riov), rparts };
+      struct qnx_io_msgsendv io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout(), const_cast<struct iovec*>(siov), sparts, const_cast<struct iovec*>(riov), rparts };
       rc = safe_ioctl(QNX_IO_MSGSENDV, &io);
    }
    else
@@ -349,24 +535,38 @@ int MsgSendv(int coid, const struct iovec* siov, int sparts, const struct iovec*
 extern "C"
 int MsgReceivev(int chid, const struct iovec* riov, int rparts, struct _msg_info* info)
 {   
-   errno = ENOSYS;
-   return -1;
-}
-
-
-extern "C"
-int MsgReceivePulse(int chid, void * pulse, int bytes, struct _msg_info * info)
-{
-   errno = ENOSYS;
-   return -1;
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      TimerStackSafe ttsf;
+      struct qnx_io_receivev io = { chid, ttsf.get_timeout(), const_cast<struct iovec*>(riov), rparts, { 0 } };      
+      rc = safe_ioctl(QNX_IO_MSGRECEIVEV, &io);
+      
+      if (rc >= 0 && info)      
+         memcpy(info, &io.info, sizeof(struct _msg_info));      
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
 }
 
 
 extern "C"
 int MsgReadv(int rcvid, const struct iovec* riov, int rparts, int offset)
 {   
-   errno = ENOSYS;
-   return -1;
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      struct qnx_io_readv io = { rcvid, offset, const_cast<struct iovec*>(riov), rparts };      
+      rc = safe_ioctl(QNX_IO_MSGREADV, &io);      
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
 }
 
 
@@ -381,8 +581,17 @@ int MsgWrite(int rcvid, const void* msg, int size, int offset)
 extern "C"
 int MsgReplyv(int rcvid, int status, const struct iovec* riov, int rparts)
 {   
-   errno = ENOSYS;
-   return -1;
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      struct qnx_io_replyv io = { rcvid, status, const_cast<struct iovec*>(riov), rparts };
+      rc = safe_ioctl(QNX_IO_MSGREPLYV, &io);
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
 }
 
 
@@ -414,7 +623,11 @@ int MsgSendNoReply(int coid, const void* smsg, int sbytes)
    if (fd >= 0)
    {
       TimerStackSafe ttsf;
-      struct qnx_io_msgsend io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout_ms(), { const_cast<void*>(smsg), (size_t)sbytes }, { 0, 0 } };
+      
+      if (ring_submit(coid & ~_NTO_SIDE_CHANNEL, QNX_RING_NOREPLY, 0, 0, 0, smsg, sbytes))
+         return 0;
+      
+      struct qnx_io_msgsend io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout(), { const_cast<void*>(smsg), (size_t)sbytes }, { 0, 0 } };
       rc = safe_ioctl(QNX_IO_MSGSENDNOREPLY, &io);
    }
    else
@@ -432,7 +645,7 @@ int MsgSendNoReplyv(int coid, const struct iovec* siov, int sparts)
    if (fd >= 0)
    {
       TimerStackSafe ttsf;
-      struct qnx_io_msgsendv io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout_ms(), const_cast<struct iovec*>(siov), sparts, 0, 0 };
+      struct qnx_io_msgsendv io = { coid & ~_NTO_SIDE_CHANNEL, ttsf.get_timeout(), const_cast<struct iovec*>(siov), sparts, 0, 0 };
       rc = safe_ioctl(QNX_IO_MSGSENDNOREPLYV, &io);
    }
    else
@@ -442,6 +655,58 @@ int MsgSendNoReplyv(int coid, const struct iovec* siov, int sparts)
 }
 
 
+extern "C"
+int MsgNoReplyNotify(int coid, int notify_coid, int code, int value)
+{
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      struct qnx_io_noreply_notify io = { coid & ~_NTO_SIDE_CHANNEL, notify_coid & ~_NTO_SIDE_CHANNEL, code, value };
+      rc = safe_ioctl(QNX_IO_NOREPLY_NOTIFY, &io);
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
+}
+
+
+extern "C"
+int MsgSendPulseBatch(const struct _pulse_batch* pulses, int num)
+{
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      struct qnx_io_msgsend_batch io = { QNX_BATCH_PULSE, num, { 0, 0 }, pulses };
+      rc = safe_ioctl(QNX_IO_MSGSEND_BATCH, &io);
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
+}
+
+
+extern "C"
+int MsgSendNoReplyBatch(const struct _noreply_batch* msgs, int num)
+{
+   int rc = -1;
+   
+   if (fd >= 0)
+   {
+      TimerStackSafe ttsf;
+      struct qnx_io_msgsend_batch io = { QNX_BATCH_NOREPLY, num, ttsf.get_timeout(), msgs };
+      rc = safe_ioctl(QNX_IO_MSGSEND_BATCH, &io);
+   }
+   else
+      errno = ESRCH;
+      
+   return rc;
+}
+
+
 extern "C"
 int MsgReceivePollFd(int chid)
 {